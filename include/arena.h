@@ -0,0 +1,52 @@
+#ifndef LSMKVSTORE_ARENA_H_
+#define LSMKVSTORE_ARENA_H_
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+
+/**
+ * @brief 内存池，按块向系统申请内存，块内用指针递增的方式分配
+ * @details 分配出去的内存不单独释放，Arena析构时一次性释放所有内存块。
+ *          MemTable的节点和value都分配在Arena上，多个写线程可以并发分配
+ */
+class Arena {
+public:
+    Arena();
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    /**
+     * @brief 分配bytes字节的内存，按指针大小对齐，线程安全
+     * @details 在当前块内原子地递增已分配的字节数，不加锁；只有当前块空间不足或申请大对象时才加锁申请新块
+     */
+    char *AllocateAligned(size_t bytes);
+
+    /**
+     * @brief 获取Arena向系统申请的内存总量
+     */
+    size_t MemoryUsage() const { return memory_usage_.load(std::memory_order_relaxed); }
+
+private:
+    struct Block {
+        char *data;
+        size_t size;
+        std::atomic<size_t> used;   // 已分配的字节数，并发分配失败时可能超过size
+    };
+
+    // 向系统申请block_bytes字节的内存块，调用者需持有mutex_
+    Block *AllocateNewBlock(size_t block_bytes);
+
+    static const size_t kBlockSize = 4096;
+    static const size_t kAlign = (sizeof(void *) > 8) ? sizeof(void *) : 8;
+
+    std::atomic<Block *> current_;      // 当前用于分配的块
+    std::mutex mutex_;                  // 保护blocks_和current_的替换
+    std::vector<Block *> blocks_;       // 所有申请过的内存块
+    std::atomic<size_t> memory_usage_;  // 申请的内存总量
+};
+
+#endif // !LSMKVSTORE_ARENA_H_
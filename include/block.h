@@ -0,0 +1,103 @@
+#ifndef LSMKVSTORE_BLOCK_H_
+#define LSMKVSTORE_BLOCK_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "dbformat.h"
+
+// 数据块由若干条记录和重启点数组组成：
+// | entry 0 | entry 1 | ... | restart[0](4B) | ... | restart[n-1](4B) | n(4B) |
+// 每条记录为：| key_delta(varint64) | tag(varint64) | val_len(varint32) | val(val_len B) |
+// key_delta是key与前一条记录的key之差，重启点处的记录保存完整的key(与0的差)，
+// 每kBlockRestartInterval条记录设置一个重启点，块内查找先在重启点上二分
+
+/**
+ * @brief 将v按变长整数编码追加到dst末尾，每字节保存7位
+ */
+void PutVarint32(std::string *dst, uint32_t v);
+void PutVarint64(std::string *dst, uint64_t v);
+
+/**
+ * @brief 从[p, limit)解码一个变长整数
+ * @return 解码后的下一个位置，数据不完整时返回nullptr
+ */
+const char *GetVarint32(const char *p, const char *limit, uint32_t *v);
+const char *GetVarint64(const char *p, const char *limit, uint64_t *v);
+
+/**
+ * @brief 生成一个数据块
+ * @details 记录必须按内部键从小到大的顺序加入
+ */
+class BlockBuilder {
+public:
+    BlockBuilder();
+    BlockBuilder(const BlockBuilder &) = delete;
+    BlockBuilder &operator=(const BlockBuilder &) = delete;
+
+    /**
+     * @brief 加入一条记录
+     * @param[in] ikey 内部键，必须大于已加入的所有内部键
+     * @param[in] val value的起始位置
+     * @param[in] len value的长度
+     */
+    void Add(const InternalKey &ikey, const char *val, size_t len);
+
+    /**
+     * @brief 在记录之后追加重启点数组，返回整个数据块的内容，之后需要Reset才能再次使用
+     */
+    const std::string &Finish();
+
+    /**
+     * @brief 清空已加入的记录
+     */
+    void Reset();
+
+    // 当前数据块的大小(包括重启点数组)
+    size_t CurrentSize() const { return buffer_.size() + (restarts_.size() + 1) * sizeof(uint32_t); }
+    bool Empty() const { return buffer_.empty(); }
+
+private:
+    std::string buffer_;
+    std::vector<uint32_t> restarts_;    // 重启点的偏移量
+    int counter_;                       // 距离上一个重启点的记录数
+    int64_t last_key_;
+};
+
+/**
+ * @brief 只读的数据块
+ */
+class Block {
+public:
+    explicit Block(std::string contents);
+
+    /**
+     * @brief 查找块内第一条内部键大于等于target的记录
+     * @details 先在重启点上二分，找到最后一个key小于target的重启点，再从该重启点开始顺序解码
+     * @param[out] ikey 找到的记录的内部键
+     * @param[out] val 找到的记录的value
+     * @return true找到，false块内所有记录都小于target
+     */
+    bool Seek(const InternalKey &target, InternalKey *ikey, std::string *val) const;
+
+    /**
+     * @brief 按顺序解码块内的所有记录，追加到entries末尾
+     */
+    void DecodeAll(std::vector<std::pair<InternalKey, std::string>> *entries) const;
+
+    // 数据块的字节数
+    size_t Size() const { return data_.size(); }
+
+private:
+    // 解码p处的记录，base为前一条记录的key(重启点处为0)，返回下一条记录的位置，数据损坏时返回nullptr
+    const char *DecodeEntry(const char *p, int64_t base, InternalKey *ikey, const char **val, uint32_t *len) const;
+    // 第i个重启点的偏移量
+    uint32_t RestartPoint(uint32_t i) const;
+
+    std::string data_;
+    uint32_t restart_offset_;   // 重启点数组的起始位置，即记录区的长度
+    uint32_t num_restarts_;
+};
+
+#endif // !LSMKVSTORE_BLOCK_H_
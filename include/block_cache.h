@@ -0,0 +1,88 @@
+#ifndef LSMKVSTORE_BLOCK_CACHE_H_
+#define LSMKVSTORE_BLOCK_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#include "block.h"
+
+/**
+ * @brief SST数据块的缓存
+ * @details 以(文件编号, 数据块偏移量)为键，容量按字节计算。按键的哈希值分成2^shard_bits个分片，
+ *          每个分片有独立的锁和LRU链表，各分片的容量为总容量的1/2^shard_bits。
+ *          缓存的数据块是只读的，返回shared_ptr，被淘汰后持有者仍然可以继续使用
+ */
+class BlockCache {
+public:
+    /**
+     * @param[in] capacity 总容量(字节)
+     * @param[in] shard_bits 分片数的对数
+     */
+    BlockCache(size_t capacity, int shard_bits);
+    BlockCache(const BlockCache &) = delete;
+    BlockCache &operator=(const BlockCache &) = delete;
+
+    /**
+     * @brief 分配一个新的文件编号，每个SST文件打开时获取一次，文件名被重复使用时也不会读到旧文件的数据块
+     */
+    uint64_t NewId() { return next_id_.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief 查找数据块，命中时移动到LRU链表头部
+     * @return 找到的数据块，未命中时为nullptr
+     */
+    std::shared_ptr<const Block> Lookup(uint64_t id, uint64_t offset);
+
+    /**
+     * @brief 插入数据块，所在分片超过容量时淘汰最久未使用的数据块
+     */
+    void Insert(uint64_t id, uint64_t offset, std::shared_ptr<const Block> block);
+
+    // 所有分片占用的总字节数
+    size_t GetUsage() const;
+    uint64_t GetHits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t GetMisses() const { return misses_.load(std::memory_order_relaxed); }
+
+private:
+    struct CacheKey {
+        uint64_t id;
+        uint64_t offset;
+        bool operator==(const CacheKey &other) const { return id == other.id && offset == other.offset; }
+    };
+
+    struct CacheKeyHash {
+        size_t operator()(const CacheKey &key) const {
+            return (key.id * 0x9E3779B97F4A7C15ULL) ^ (key.offset * 0xC2B2AE3D27D4EB4FULL);
+        }
+    };
+
+    struct Entry {
+        CacheKey key;
+        std::shared_ptr<const Block> block;
+        size_t charge;      // 该数据块占用的字节数
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;   // 头部是最近使用的数据块
+        std::unordered_map<CacheKey, std::list<Entry>::iterator, CacheKeyHash> map;
+        size_t usage = 0;
+    };
+
+    Shard &GetShard(const CacheKey &key);
+
+    size_t shard_capacity_;
+    int shard_bits_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> next_id_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+#endif // !LSMKVSTORE_BLOCK_CACHE_H_
@@ -0,0 +1,67 @@
+#ifndef LSMKVSTORE_BLOCK_INDEX_H_
+#define LSMKVSTORE_BLOCK_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "dbformat.h"
+#include "learned_index.h"
+#include "table_builder.h"
+
+/**
+ * @brief 常驻内存的SST数据块索引
+ * @details 数据块按顺序保存在handles_中，供遍历和读取数据块使用。查找时不在handles_上二分，
+ *          而是在按Eytzinger(BFS)顺序排列的key数组上查找：第k个节点的左右孩子为2k和2k+1，
+ *          查找路径上前几层的节点集中在少数几个cache line中，更深的节点可以提前预取，
+ *          每一步只比较一个int64_t，用比较结果计算下一个节点，没有分支预测失败。
+ *          SST文件中保存了学习索引时不生成Eytzinger数组，先用学习索引预测数据块的序号，
+ *          再在handles_中误差范围内的几个数据块上二分
+ */
+class BlockIndex {
+public:
+    BlockIndex() {}
+    /**
+     * @param[in] handles 按顺序排列的所有数据块
+     * @param[in] learned SST文件中保存的学习索引(见learned_index.h)，为空时使用Eytzinger数组
+     */
+    explicit BlockIndex(std::vector<BlockHandle> handles, const std::string &learned = "");
+
+    size_t Size() const { return handles_.size(); }
+    bool Empty() const { return handles_.empty(); }
+    const BlockHandle &operator[](size_t i) const { return handles_[i]; }
+    std::vector<BlockHandle>::const_iterator begin() const { return handles_.begin(); }
+    std::vector<BlockHandle>::const_iterator end() const { return handles_.end(); }
+
+    /**
+     * @brief 查找第一个最后一条记录的key不小于key的数据块
+     * @return 数据块的序号，所有数据块的key都小于key时返回Size()
+     */
+    size_t LowerBound(int64_t key) const;
+
+    /**
+     * @brief 查找第一个最后一条记录的内部键不小于target的数据块，即第一个可能包含target的数据块
+     * @return 数据块的序号，没有时返回Size()
+     */
+    size_t LowerBound(const InternalKey &target) const;
+
+    // 索引占用的内存字节数
+    size_t MemoryUsage() const;
+
+    // 是否使用学习索引查找
+    bool UseLearnedIndex() const { return !learned_.Empty(); }
+
+private:
+    // 按中序遍历把handles_[i...]依次填入以k为根的子树，返回下一个要填入的序号
+    size_t Build(size_t i, size_t k);
+    // 在handles_[lo, hi)中二分查找第一个最后一条记录的key不小于key的数据块
+    size_t Search(int64_t key, size_t lo, size_t hi) const;
+
+    std::vector<BlockHandle> handles_;  // 按顺序排列的数据块
+    std::vector<int64_t> keys_;         // Eytzinger顺序的最后一条记录的key，下标从1开始
+    std::vector<uint32_t> ranks_;       // keys_[k]对应的数据块在handles_中的序号
+    LearnedIndex learned_;              // 学习索引，为空时使用keys_
+};
+
+#endif // !LSMKVSTORE_BLOCK_INDEX_H_
@@ -0,0 +1,69 @@
+#ifndef LSMKVSTORE_BLOOM_FILTER_H_
+#define LSMKVSTORE_BLOOM_FILTER_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 布隆过滤器有两种格式，由最后一个字节区分：
+// 1. 标准格式：| bits(n B) | num_probes(1B) |
+//    位数组的长度由key的个数和bits_per_key决定，num_probes为每个key设置的位数(1~30)。
+//    每个key只计算一次MurmurHash3_x64_128，得到的两个64位哈希值h1、h2按双重哈希生成
+//    第i个探测位置：(h1 + i * h2) % 位数
+// 2. 分块格式：| block 0(64B) | ... | block n-1(64B) | num_probes(1B) | kBlockedMarker(1B) |
+//    h1选择一个与cache line等大的块，块内的8个64位字各设置一位，第j个字的位置由
+//    (uint32_t)h2 * kSalt[j]的高6位决定。一次查询只访问一个cache line，8个探测可以用AVX2并行完成
+
+/**
+ * @brief 只读的布隆过滤器
+ */
+class BloomFilter {
+public:
+    BloomFilter() : blocked_(false), num_probes_(0), num_blocks_(0) {}
+    explicit BloomFilter(std::string contents);
+
+    /**
+     * @brief 根据key的集合生成布隆过滤器
+     * @param[in] keys 所有key，不需要去重
+     * @param[in] bits_per_key 每个key占用的位数，标准格式的误判率约为0.6185^bits_per_key，分块格式略高
+     * @param[in] blocked 是否生成分块格式
+     * @return 过滤器的内容
+     */
+    static std::string Build(const std::vector<int64_t> &keys, int bits_per_key, bool blocked);
+
+    /**
+     * @brief 判断key是否可能存在
+     * @return false肯定不存在，true可能存在。过滤器为空或损坏时总是返回true
+     */
+    bool KeyMayMatch(int64_t key) const;
+
+    /**
+     * @brief 批量判断多个key是否可能存在
+     * @details 分块格式下先计算所有key的哈希值并预取对应的块，再依次探测，隐藏访存延迟
+     * @param[in] keys 要判断的key
+     * @param[in] n key的个数
+     * @param[out] results 每个key的结果，含义同KeyMayMatch
+     */
+    void KeysMayMatch(const int64_t *keys, size_t n, bool *results) const;
+
+    // 过滤器的字节数
+    size_t Size() const { return data_.size(); }
+
+    // 是否为分块格式
+    bool IsBlocked() const { return blocked_; }
+
+    // 当前CPU是否支持AVX2，分块格式据此选择探测的实现
+    static bool HasAvx2();
+
+private:
+    // 分块格式中哈希值h1对应的块
+    const char *BlockFor(uint64_t h1) const;
+
+    std::string data_;
+    bool blocked_;
+    int num_probes_;
+    uint64_t num_blocks_;   // 分块格式的块数
+};
+
+#endif // !LSMKVSTORE_BLOOM_FILTER_H_
@@ -75,6 +75,21 @@ public:
         }
     }
 
+    /**
+     * @brief 获取指定key对应的value的拷贝
+     * @details 与Get不同，拷贝在持有锁时完成，返回后元素被其他线程淘汰也不影响结果
+     * @param[in] key 要查找的键
+     * @param[out] value 找到的值
+     * @return true存在该key，false不存在
+    */
+    bool TryGet(const Key &key, Value *value) const {
+        mutex_guard lock(mutex_);
+
+        std::pair<const_iterator, bool> pair = VisitKey(key);
+        if (pair.second) *value = pair.first->second;
+        return pair.second;
+    }
+
     /**
      * @brief 判断key是否已在cache中
      * @param[in] key 要查找的键
@@ -106,11 +121,10 @@ public:
         }
     }
 
-protected:
     /**
      * @brief 重置缓存器
     */
-   void Clear() {
+    void Clear() {
         mutex_guard lock(mutex_);
 
         // 清空cache_policy_
@@ -120,7 +134,9 @@ protected:
 
         // 清空cache_items_map_
         cache_items_map_.clear();
-   }
+    }
+
+protected:
 
    const_iterator begin() const noexcept {
         return cache_items_map_.cbegin();
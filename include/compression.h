@@ -0,0 +1,35 @@
+#ifndef LSMKVSTORE_COMPRESSION_H_
+#define LSMKVSTORE_COMPRESSION_H_
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// 数据块的压缩算法，编号写在每个数据块的最后一个字节，修改时只能追加
+enum CompressionType : uint8_t {
+    kNoCompression = 0,
+    kFastCompression = 1,   // 内置的LZ77压缩，不依赖第三方库
+    kLZ4Compression = 2,    // 编译时找到lz4才可用
+    kZstdCompression = 3    // 编译时找到zstd才可用
+};
+
+/**
+ * @brief 当前构建是否支持该压缩算法
+ */
+bool CompressionSupported(CompressionType type);
+
+/**
+ * @brief 压缩[data, data + n)
+ * @param[out] output 压缩后的内容
+ * @return false不支持该算法或压缩失败
+ */
+bool Compress(CompressionType type, const char *data, size_t n, std::string *output);
+
+/**
+ * @brief 解压[data, data + n)
+ * @param[out] output 解压后的内容
+ * @return false不支持该算法或数据损坏
+ */
+bool Uncompress(CompressionType type, const char *data, size_t n, std::string *output);
+
+#endif // !LSMKVSTORE_COMPRESSION_H_
@@ -0,0 +1,42 @@
+#ifndef LSMKVSTORE_DBFORMAT_H_
+#define LSMKVSTORE_DBFORMAT_H_
+
+#include <cstdint>
+
+// 序列号，每次写入(Put/Del)分配一个，越新的写入序列号越大
+using SequenceNumber = uint64_t;
+
+// 最大的序列号，用它读取时能看到所有已经写入的数据。
+// SST文件中序列号和类型合并存放在8字节中，序列号只使用低56位
+const SequenceNumber kMaxSequenceNumber = (1ULL << 56) - 1;
+
+// MemTable和SST文件中一个版本的类型
+enum ValueType : uint8_t {
+    kTypeDeletion = 0,  // 删除标记，value为空
+    kTypeValue = 1      // 插入/更新
+};
+
+// 将序列号和类型合并为8字节的tag：高56位为序列号，低8位为类型
+inline uint64_t PackSequenceAndType(SequenceNumber seq, ValueType type) {
+    return (seq << 8) | type;
+}
+
+/**
+ * @brief 内部键，由用户键、序列号和类型组成
+ * @details MemTable和SST文件中同一个key可能有多个版本，按key从小到大、
+ *          key相同时按序列号从大到小(从新到旧)排列。序列号不会重复，类型不参与比较
+ */
+struct InternalKey {
+    int64_t key;
+    SequenceNumber seq;
+    ValueType type = kTypeValue;
+
+    bool operator<(const InternalKey &other) const {
+        return (key == other.key) ? (seq > other.seq) : (key < other.key);
+    }
+    bool operator==(const InternalKey &other) const {
+        return key == other.key && seq == other.seq;
+    }
+};
+
+#endif // !LSMKVSTORE_DBFORMAT_H_
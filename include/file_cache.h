@@ -0,0 +1,92 @@
+#ifndef LSMKVSTORE_FILE_CACHE_H_
+#define LSMKVSTORE_FILE_CACHE_H_
+
+#include <string>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "cache.h"
+#include "io_backend.h"
+#include "lru_cache_policy.h"
+
+/**
+ * @brief 只读的随机访问文件
+ * @details 构造时打开文件并一直持有文件描述符，读取使用pread，不修改文件偏移量，
+ *          多个线程可以同时读取同一个对象
+ */
+class RandomAccessFile {
+public:
+    explicit RandomAccessFile(const std::string &file_name);
+    RandomAccessFile(const RandomAccessFile &) = delete;
+    RandomAccessFile &operator=(const RandomAccessFile &) = delete;
+    ~RandomAccessFile();
+
+    bool IsOpen() const { return fd_ >= 0; }
+
+    /**
+     * @brief 从offset处读取n个字节到buf，处理部分读和EINTR
+     * @return true读满n个字节，false读取失败或到达文件末尾
+     */
+    bool Read(uint64_t offset, size_t n, char *buf) const;
+
+    /**
+     * @brief 通过当前线程的IoBackend一次提交多个读请求，全部完成后返回
+     * @param[in,out] reqs 每个请求的offset、n和buf，fd由本函数填写，完成后ok表示是否读满
+     */
+    void ReadBatch(ReadRequest *reqs, size_t n) const;
+
+    int Fd() const { return fd_; }
+
+    // 打开时的文件大小
+    uint64_t Size() const { return size_; }
+
+private:
+    int fd_;
+    uint64_t size_;
+};
+
+/**
+ * @brief 已打开的SST文件的LRU缓存
+ * @details 每个SST文件最多持有一个文件描述符，超过容量时关闭最久未使用的文件，
+ *          使打开的文件数不超过options::kMaxOpenFiles。被淘汰的文件如果仍被读线程或迭代器持有，
+ *          在最后一个持有者释放时才关闭。被迭代器引用(Pin)的文件在删除前保留一个句柄，
+ *          迭代器之后再打开该文件时仍能读到
+ */
+class FileCache {
+public:
+    explicit FileCache(std::size_t capacity);
+    FileCache(const FileCache &) = delete;
+    FileCache &operator=(const FileCache &) = delete;
+
+    /**
+     * @brief 获取文件的句柄，不在缓存中时打开文件并加入缓存
+     * @return 文件的句柄，打开失败时IsOpen()为false且不会加入缓存
+     */
+    std::shared_ptr<RandomAccessFile> Open(const std::string &file_name);
+
+    /**
+     * @brief 将文件移出缓存，删除文件前调用，避免之后同名的新文件读到旧的句柄
+     * @details 文件仍被引用时先打开并保留句柄，直到最后一次Unpin
+     */
+    void Evict(const std::string &file_name);
+
+    /**
+     * @brief 增加文件的引用计数，延迟打开文件的迭代器在创建时调用，调用者需保证文件此时还没有被删除
+     */
+    void Pin(const std::string &file_name);
+
+    /**
+     * @brief 减少文件的引用计数，计数为0时释放Evict保留的句柄
+     */
+    void Unpin(const std::string &file_name);
+
+private:
+    caches::FixedSizeCache<std::string, std::shared_ptr<RandomAccessFile>, caches::LRUCachePolicy> cache_;
+    std::mutex mutex_;                                  // 保护pins_和retained_
+    std::unordered_map<std::string, int> pins_;         // 被迭代器引用的文件及引用次数
+    std::unordered_map<std::string, std::shared_ptr<RandomAccessFile>> retained_;  // 已删除但仍被引用的文件
+};
+
+#endif // !LSMKVSTORE_FILE_CACHE_H_
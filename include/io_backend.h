@@ -0,0 +1,127 @@
+#ifndef LSMKVSTORE_IO_BACKEND_H_
+#define LSMKVSTORE_IO_BACKEND_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+#include "rate_limiter.h"
+
+/**
+ * @brief 一个读请求
+ */
+struct ReadRequest {
+    int fd;
+    uint64_t offset;
+    size_t n;
+    char *buf;
+    bool ok;    // 完成后是否读满n个字节
+};
+
+/**
+ * @brief 从offset处读取n个字节到buf，处理部分读和EINTR
+ * @return true读满n个字节，false读取失败或到达文件末尾
+ */
+bool ReadFully(int fd, uint64_t offset, size_t n, char *buf);
+
+/**
+ * @brief 把[data, data + n)写入offset处，处理部分写和EINTR
+ */
+bool WriteFully(int fd, uint64_t offset, const char *data, size_t n);
+
+/**
+ * @brief 文件读写的后端
+ * @details 批量提交读请求，以及异步提交写请求。一个对象只能由一个线程使用，
+ *          读取和写文件都使用ForCurrentThread()返回的每个线程独有的对象。
+ *          写请求的结果按文件描述符分别记录，同一个线程交替写多个文件时互不影响
+ */
+class IoBackend {
+public:
+    virtual ~IoBackend() {}
+
+    /**
+     * @brief 读取一批请求，全部完成后返回
+     * @param[in,out] reqs 读请求，完成后设置每个请求的ok
+     * @param[in] n 请求数
+     */
+    virtual void Read(ReadRequest *reqs, size_t n) = 0;
+
+    /**
+     * @brief 提交一个写请求，不等待写入完成。data在写入完成前由后端持有
+     * @details 正在进行的写请求达到队列深度时，等待其中一个完成
+     */
+    virtual void Write(int fd, uint64_t offset, std::string data) = 0;
+
+    /**
+     * @brief 等待已提交的写fd的请求全部完成
+     * @return 上次调用以来提交的写fd的请求是否都成功
+     */
+    virtual bool WaitForWrites(int fd) = 0;
+
+    virtual const char *Name() const = 0;
+
+    /**
+     * @brief 创建后端。use_io_uring为true且内核支持io_uring时使用io_uring，否则使用pread/pwrite
+     * @param[in] depth 同时提交的请求数上限
+     */
+    static std::unique_ptr<IoBackend> Create(bool use_io_uring, unsigned depth);
+
+    /**
+     * @brief 当前线程的后端，按options::kUseIoUring和options::kIoQueueDepth创建，线程退出时销毁
+     */
+    static IoBackend *ForCurrentThread();
+
+protected:
+    // 记录一个写fd的请求失败
+    void MarkWriteFailed(int fd);
+    // 返回写fd的请求是否都成功，并清除fd的失败记录
+    bool TakeWriteStatus(int fd);
+
+private:
+    std::vector<int> failed_fds_;   // 写请求失败且还没有被WaitForWrites取走的文件描述符
+};
+
+/**
+ * @brief 只写的顺序文件
+ * @details 写入的内容先放入缓冲区，缓冲区满options::kWritableFileBufferSize时作为一个写请求提交给后端，
+ *          使用io_uring时写线程不等待写入完成，可以继续生成下一段内容。提交前先向rate_limiter申请令牌。
+ *          使用创建它的线程的IoBackend，只能在该线程中使用
+ */
+class WritableFile {
+public:
+    /**
+     * @param[in] rate_limiter 后台写入的限速器，为nullptr时不限速
+     * @param[in] priority 向rate_limiter申请令牌的优先级
+     */
+    explicit WritableFile(const std::string &file_name, RateLimiter *rate_limiter = nullptr,
+                          IoPriority priority = IoPriority::kLow);
+    WritableFile(const WritableFile &) = delete;
+    WritableFile &operator=(const WritableFile &) = delete;
+    ~WritableFile();
+
+    bool IsOpen() const { return fd_ >= 0; }
+
+    // 追加写入[data, data + n)
+    void Append(const char *data, size_t n);
+
+    /**
+     * @brief 提交缓冲区中剩余的内容，等待所有写请求完成，fdatasync后关闭文件
+     * @return 所有写入和刷盘是否成功
+     */
+    bool Close();
+
+private:
+    // 把缓冲区作为一个写请求提交
+    void Flush();
+
+    int fd_;
+    uint64_t offset_;       // 已提交的字节数
+    std::string buffer_;
+    IoBackend *backend_;            // 创建时所在线程的后端，不持有所有权
+    RateLimiter *rate_limiter_;     // 不持有所有权
+    IoPriority priority_;
+};
+
+#endif // !LSMKVSTORE_IO_BACKEND_H_
@@ -0,0 +1,74 @@
+#ifndef LSMKVSTORE_ITERATOR_H_
+#define LSMKVSTORE_ITERATOR_H_
+
+#include <string>
+#include <cstdint>
+
+#include "dbformat.h"
+
+/**
+ * @brief 有序遍历键值对的迭代器抽象类
+ * @details MemTable、SST文件和存储引擎都通过该接口提供按key从小到大(或从大到小)的遍历
+ */
+class Iterator {
+public:
+    Iterator() = default;
+    Iterator(const Iterator &) = delete;
+    Iterator &operator=(const Iterator &) = delete;
+    virtual ~Iterator() = default;
+
+    /**
+     * @brief 迭代器是否指向一个键值对
+     */
+    virtual bool Valid() const = 0;
+
+    /**
+     * @brief 定位到第一个键值对
+     */
+    virtual void SeekToFirst() = 0;
+
+    /**
+     * @brief 定位到最后一个键值对
+     */
+    virtual void SeekToLast() = 0;
+
+    /**
+     * @brief 定位到第一个key大于等于key的键值对
+     * @param[in] key 目标键
+     */
+    virtual void Seek(int64_t key) = 0;
+
+    /**
+     * @brief 移动到下一个键值对，调用前需保证Valid()
+     */
+    virtual void Next() = 0;
+
+    /**
+     * @brief 移动到上一个键值对，调用前需保证Valid()
+     */
+    virtual void Prev() = 0;
+
+    /**
+     * @brief 获取当前键值对的key，调用前需保证Valid()
+     */
+    virtual int64_t Key() const = 0;
+
+    /**
+     * @brief 获取当前键值对的value，调用前需保证Valid()
+     */
+    virtual std::string Value() const = 0;
+};
+
+/**
+ * @brief 存储引擎内部使用的迭代器
+ * @details 除键值对外还输出删除标记，由StoreIterator过滤后再提供给外部
+ */
+class InternalIterator : public Iterator {
+public:
+    /**
+     * @brief 获取当前版本的类型，调用前需保证Valid()
+     */
+    virtual ValueType Type() const = 0;
+};
+
+#endif // !LSMKVSTORE_ITERATOR_H_
@@ -2,6 +2,7 @@
 #define LSMKVSTORE_KVSTORE_H_
 
 #include <future>
+#include <algorithm>
 #include <cstdint>
 #include <map>
 #include <memory>
@@ -12,16 +13,27 @@
 #include <vector>
 #include <string>
 #include <queue>
+#include <deque>
+#include <unordered_set>
 #include <thread>
+#include <tuple>
+#include <stdexcept>
 #include <string.h>
 
 #include "kvstore_api.h"
 #include "table_cache.h"
+#include "table_builder.h"
+#include "file_cache.h"
+#include "block_cache.h"
+#include "rate_limiter.h"
 #include "cache.h"
 #include "thread_pool.h"
 #include "options.h"
 #include "utils.h"
 #include "skiplist.h"
+#include "wal.h"
+#include "write_batch.h"
+#include "merging_iterator.h"
 
 #ifdef FIFO
 #include "fifo_cache_policy.h"
@@ -39,65 +51,344 @@ using cache_t = typename caches::FixedSizeCache<K, V, caches::LFUCachePolicy>;
 
 class KVStore : public KVStoreAPI {
 public:
-    KVStore(const std::string &dir);
+    /**
+     * @brief 打开dir目录下的存储引擎
+     * @details 加载已有的SST文件元信息，并回放WAL恢复上次未落盘的写入
+     * @param[in] dir SSTable和WAL文件的存放目录
+     * @param[in] wal_sync_mode WAL的刷盘策略
+     * @param[in] compaction_style compaction策略，两种策略的文件布局兼容，可以在重新打开时切换
+     */
+    KVStore(const std::string &dir, options::WalSyncMode wal_sync_mode = options::kWalSyncMode,
+            options::CompactionStyle compaction_style = options::kCompactionStyle);
     ~KVStore();
 
     void Put(uint64_t key, const std::string &val, bool to_cache = true) override;
     // 将Put函数封装为任务，以便丢进线程池
     void PutTask(uint64_t key, const std::string &val, bool to_cache = true);
 
-    std::string Get(uint64_t key) override;
+    std::string Get(uint64_t key, const Snapshot *snapshot = nullptr) override;
     // 将Get函数封装为任务，以便丢进线程池。返回一个包含key对应val的future对象
     std::future<std::string> GetTask(uint64_t key);
 
+    /**
+     * @brief 批量查找多个key
+     * @details key排序去重后，在一次rw_mutex_加锁中查完缓存和所有MemTable；剩下的key逐层按可能包含它们的
+     *          SST文件分组，每个文件批量判断布隆过滤器、每个数据块只读取一次，同一层的多个文件并行读取
+     * @param[in] keys 要查找的key，可以重复
+     * @param[in] snapshot 读取的快照，为nullptr时读取最新的数据
+     * @return 与keys一一对应的value，key不存在时为""
+     */
+    std::vector<std::string> MultiGet(const std::vector<uint64_t> &keys, const Snapshot *snapshot = nullptr);
+
     bool Del(uint64_t key, bool to_cache = true) override;
     // 将Del函数封装为任务，以便丢进线程池
     void DelTask(uint64_t key, bool to_cache = true);
 
+    /**
+     * @brief 原子地写入一批Put/Del操作
+     * @details 整批操作作为一条WAL记录写入，并在一次rw_mutex_加锁中写入MemTable，
+     *          期间至多切换一次MemTable
+     * @param[in] batch 要写入的操作
+     * @param[in] to_cache 是否缓存batch中插入的键值对
+     * @return true写入成功，false WAL写入失败，batch中的操作都没有生效。
+     *         WAL写入失败后之后的写入都返回false，直到Reset
+     */
+    bool Write(const WriteBatch &batch, bool to_cache = false);
+    // 将Write函数封装为任务，以便丢进线程池
+    void WriteTask(const WriteBatch &batch, bool to_cache = false);
+
+    /**
+     * @brief 创建遍历整个存储引擎的迭代器
+     * @details 按mem_table_、immutable_tables_(从新到旧)、level0的SST文件(从新到旧)、level1及以上各层的顺序归并，
+     *          同一个key只输出最新的版本，被删除的key不会输出。level1及以上每层只有一个延迟打开文件的LevelIterator
+     */
+    std::unique_ptr<Iterator> NewIterator(const Snapshot *snapshot = nullptr) override;
+
+    std::vector<std::pair<uint64_t, std::string>> Scan(uint64_t lo, uint64_t hi, size_t limit,
+                                                       const Snapshot *snapshot = nullptr) override;
+
+    const Snapshot *GetSnapshot() override;
+    void ReleaseSnapshot(const Snapshot *snapshot) override;
+
     // 删除所有SST文件及文件夹
     void Reset() override;
 
 private:
+    // 一个等待组提交的写请求
+    struct Writer {
+        const WriteBatch *batch = nullptr;  // 要写入的操作
+        bool to_cache = false;  // 是否缓存写入的键值对
+        bool exclusive = false; // 为true时不参与组提交，只用于独占写入队列(如Reset)
+        bool done = false;      // 是否已由leader完成写入
+        bool ok = true;         // leader写入WAL是否成功，失败时整组都不写入mem_table_
+        SequenceNumber sequence = 0;    // batch中第一个操作的序列号，由leader分配
+        Writer *leader = nullptr;   // 非空时由该leader指派，与leader并发地写入mem_table_
+        size_t pending_apply = 0;   // leader等待完成并发写入的写请求数
+        std::condition_variable cv;
+    };
+
+    /**
+     * @brief 组提交
+     * @details 写请求进入writers_队列，队头的写请求成为leader，将队列中排在其后的写请求
+     *          合并为一条WAL记录，只进行一次write和一次fdatasync，然后统一写入mem_table_，
+     *          最后唤醒被合并的写请求。返回时w已经写入WAL和mem_table_。
+     *          各写请求的key没有重叠时，由各自的线程并发写入mem_table_。
+     *          WAL写入失败时整组都不写入mem_table_，也不分配序列号
+     * @return true写入成功，false WAL写入失败，同组的所有写请求都返回false
+     */
+    bool GroupCommit(Writer *w);
+
+    /**
+     * @brief 判断一组写请求之间是否写入了相同的key
+     * @details 跳表中的版本由序列号排序，但相同的key并发写入时cache_中最终保留的value
+     *          可能不是最新的，此时由leader顺序写入
+     */
+    static bool KeysOverlap(const std::vector<Writer *> &group);
+
+    /**
+     * @brief 将一个写请求中的所有操作写入mem_table_，调用者需持有rw_mutex_读锁，防止mem_table_被切换
+     * @details 第i个操作的序列号为w->sequence + i
+     */
+    void ApplyBatch(const Writer *w);
+
+    /**
+     * @brief 如果mem_table_的Arena内存加上size字节超过options::kMemTable，则将其加入immutable_tables_队尾，
+     *        切换到新的WAL文件，并在没有flush任务时向flush线程池提交MinorCompaction
+     * @details 只会被组提交的leader调用。只有immutable memtable的数量达到上限时才会等待flush
+     * @return flush失败时返回false，此时不能再写入
+     */
+    bool MakeRoomForWrite(size_t size);
+
+    /**
+     * @brief 加载dir_目录下所有SST文件的元信息，记录level_num_vec_、time_stamp_和last_sequence_
+     */
+    void LoadTables();
+
+    /**
+     * @brief 按序回放WAL目录下的所有WAL文件，并将回放得到的跳表写入level0
+     * @details 每条物理记录开头是其中第一个操作的序列号，回放时恢复last_sequence_。
+     *          写入level0失败时抛出std::runtime_error并保留所有WAL文件
+     */
+    void Recover();
+
     /**
-     * @brief immutable memtable ->  level0 SST文件
-     * @details 会调用MajorCompaction(1)检查Level0是否需要进行MajorCompaction
+     * @brief 创建一个新的WAL文件供后续写入使用
+     */
+    void NewWal();
+
+    /**
+     * @brief 根据sstable_meta_info_[level]重建该层的查找结构level_files_[level]
+     * @details 每次修改sstable_meta_info_后调用，调用者需持有meta_mutex_写锁
+     */
+    void RebuildLevelFiles(int level);
+
+    /**
+     * @brief 获取最旧的快照的序列号，没有快照时返回last_sequence_
+     * @details flush和compaction只丢弃对该序列号不可见的旧版本
+     */
+    SequenceNumber SmallestSnapshot();
+
+    /**
+     * @brief 将跳表保存为level0层的SST文件并记录其元信息
+     * @details 写文件时不持有meta_mutex_，只在记录元信息时加写锁
+     * @return 文件和目录是否都已刷盘，失败时已删除写了一半的文件，不记录元信息
+     */
+    bool StoreToLevel0(SkipList *table);
+
+    /**
+     * @brief flush任务：按从旧到新的顺序将immutable_tables_中的跳表逐个保存为level0层的SST文件
+     * @details 在只有一个线程的flush线程池中执行，保证level0文件的顺序。每保存一个跳表都调用
+     *          MaybeScheduleCompaction，compaction在另一个线程池中进行，不会增加flush的耗时。
+     *          level0的文件数达到kL0StopWritesTrigger时先等待compaction。队列为空时任务结束
      */
     void MinorCompaction();
 
     /**
-     * @brief 如果level-1层SST文件数量超过限制，则将level-1层的SST文件与level层的SST文件合并放到level层
-     * @details 采用多路归并排序
-     * @param[in] level 检查level-1层是否要进行compaction
+     * @brief 为超过目标大小的层提交compaction任务
+     * @details universal模式下有序序列数达到kL0CompactionTrigger且没有正在进行的任务时提交一个
+     *          UniversalCompaction。leveled模式下level0的得分为文件数 / kL0CompactionTrigger，其他层为总字节数 / 目标大小，
+     *          得分不小于1的层按得分从大到小提交，相关的两层不会同时合并，同时进行的任务数不超过
+     *          kMaxBackgroundCompactions。调用者需持有meta_mutex_写锁
      */
-    void MajorCompaction(int level);
+    void MaybeScheduleCompaction();
+
+    // 总层数，至少为options::kNumLevels。调用者需持有meta_mutex_
+    int NumLevels() const { return std::max<int>(options::kNumLevels, sstable_meta_info_.size()); }
+
+    // level层所有SST文件的总字节数。调用者需持有meta_mutex_
+    uint64_t LevelBytes(int level) const;
 
     /**
-     * @brief 将合并后的SST文件从内存写回磁盘
-     * @details 只会被MajorCompaction函数调用
+     * @brief 计算level1及以上各层的目标大小
+     * @details 见options::kLevelCompactionDynamicLevelBytes。基础层不会低于第一个有文件的层。
+     *          调用者需持有meta_mutex_
+     * @param[out] base_level 基础层，level0合并到这一层
+     * @return 每层的目标字节数，level0和基础层之上的层为0
      */
-    void WriteToFile(int level, uint64_t time_stamp, uint64_t num_pair, std::map<int64_t, std::string> &new_table);
+    std::vector<uint64_t> LevelMaxBytes(int *base_level) const;
 
-private:
-    enum mode {
-        normal,
-        compact,
-        exits
+    // 待完成的compaction要重写的字节数的估计值。调用者需持有meta_mutex_
+    uint64_t PendingCompactionBytes() const;
+
+    /**
+     * @brief 根据待完成的compaction数据量调整后台写入的限速
+     * @details 在kRateLimitBytesPerSec和kRateLimitMaxBytesPerSec之间按PendingCompactionBytes() /
+     *          kRateLimitDebtForMaxBytes线性插值。每次文件元信息变化后由MaybeScheduleCompaction调用。
+     *          调用者需持有meta_mutex_
+     */
+    void TuneRateLimiter();
+
+    /**
+     * @brief 一个有序序列：level0中时间戳相同的文件，或level1及以上的一整层
+     */
+    struct SortedRun {
+        int level;
+        std::vector<TableCache> files;
+        uint64_t bytes;     // 所有文件的总字节数
     };
 
+    // 按从新到旧的顺序返回所有有序序列。调用者需持有meta_mutex_
+    std::vector<SortedRun> SortedRuns() const;
+
+    // flush前检查的level0压力：leveled模式下为level0的文件数，universal模式下为有序序列数。调用者需持有meta_mutex_
+    int L0Pressure() const;
+
+    /**
+     * @brief universal模式的compaction任务：执行UniversalCompaction，结束后检查是否需要继续提交
+     * @details 在compaction线程池中执行
+     */
+    void BackgroundUniversalCompaction();
+
+    /**
+     * @brief 选择从新到旧相邻的若干个有序序列合并成一个
+     * @details 依次尝试：除最旧序列外的总大小超过最旧序列的kUniversalMaxSizeAmplificationPercent%时合并所有序列；
+     *          从新到旧找到第一组至少kUniversalMinMergeWidth个大小相近的相邻序列；合并最新的若干个序列使序列数
+     *          降到kL0CompactionTrigger以下。每个版本只在合并时被重写一次，不像leveled模式每向下一层都要重写
+     *          下一层有交集的文件，写放大小，代价是读取时要查找更多的序列。调用者不能持有meta_mutex_
+     */
+    void UniversalCompaction();
+
+    /**
+     * @brief compaction任务：执行MajorCompaction，结束后清除两层的标记，
+     *        并检查是否需要继续提交compaction任务
+     * @details 在compaction线程池中执行
+     */
+    void BackgroundCompaction(int input_level, int output_level);
+
+    /**
+     * @brief 将input_level层的SST文件与output_level层key范围有交集的文件合并，放到output_level层
+     * @details input_level为0时合并level0的所有文件，output_level为基础层；否则从input_level层选择一个文件，
+     *          output_level为下一层，选择与下一层有交集的文件总大小相对自身大小最小的文件，减少写放大。
+     *          选择输入文件后由CompactFiles合并。只在选择输入文件和替换元信息时持有meta_mutex_写锁，
+     *          读取和写入文件期间不阻塞Get。同一个key的旧版本只有对某个快照可见时才保留，
+     *          同一个key的所有版本写入同一个SST文件。调用者不能持有meta_mutex_
+     */
+    void MajorCompaction(int input_level, int output_level);
+
+    /**
+     * @brief 合并输入文件，写入level层，并一次性替换元信息、删除输入文件
+     * @details 输入数据较多时按输入文件的最小最大key切分成至多kMaxSubcompactions个key范围，
+     *          由DoSubcompaction并行归并，所有输出文件在一次加锁中一起替换被合并的文件。
+     *          level层中不属于输入的文件与输入的key范围不能有交集(level0除外)。调用者不能持有meta_mutex_
+     * @param[in] inputs inputs[i]为从level i中移除的文件
+     * @param[in] time_stamp 输出文件的时间戳
+     * @param[in] last_level 比输入更旧的数据是否都不存在，为true时丢弃对所有快照可见的删除标记
+     */
+    void CompactFiles(const std::vector<std::vector<TableCache>> &inputs, int level, uint64_t time_stamp,
+                      bool last_level);
+
+    /**
+     * @brief 一次compaction按key范围切分出的子任务
+     * @details 各子任务的key范围互不重叠，分别归并与范围有交集的输入文件，写入各自的输出文件
+     */
+    struct Subcompaction {
+        int level;                          // 输出文件所在的层
+        uint64_t time_stamp;                // 输出文件的时间戳
+        bool last_level;                    // level是否为最后一层
+        SequenceNumber smallest_snapshot;   // 最旧的存活快照
+        int64_t start;                      // key范围的起点(包含)
+        int64_t end;                        // key范围的终点(不包含)，has_end为false时没有终点
+        bool has_end;
+        std::vector<TableCache> inputs;     // 与key范围有交集的输入文件
+        std::vector<TableCache> outputs;    // 已写完的输出文件，由MajorCompaction统一加入sstable_meta_info_
+        bool ok = true;                     // 输出文件是否都写入并刷盘成功
+    };
+
+    /**
+     * @brief 归并一个子任务的key范围内的所有版本并写入level层的新文件
+     * @details 用小顶堆对每个输入文件的顺序读取器多路归并，边合并边写入输出文件，
+     *          内存占用与输入文件的大小无关。不持有锁，只在分配文件序号时持有meta_mutex_
+     */
+    void DoSubcompaction(Subcompaction *sub);
+
+    /**
+     * @brief 在level层创建一个新的SST文件
+     * @details 只会被DoSubcompaction函数调用，只在分配文件序号时持有meta_mutex_
+     * @param[in] compression 数据块使用的压缩算法
+     * @param[out] file_name 新文件的文件名，文件写完后由调用者打开并加入sstable_meta_info_
+     */
+    std::unique_ptr<TableBuilder> NewTableBuilder(int level, uint64_t time_stamp, CompressionType compression,
+                                                  std::string *file_name);
+
+private:
     std::shared_ptr<SkipList> mem_table_;
-    std::shared_ptr<SkipList> immutable_table_;
+    // 等待写入level0的immutable memtable，队头最旧，队尾最新
+    std::deque<std::shared_ptr<SkipList>> immutable_tables_;
+    std::deque<std::string> imm_wal_files_;     // immutable_tables_对应的WAL文件，落盘后删除
+    bool flush_scheduled_;                      // 是否已经提交了MinorCompaction任务
+    // WAL写入、flush或compaction失败后置位，之后的写入都失败，也不再进行flush和compaction，直到Reset
+    std::atomic<bool> bg_error_;
 
     std::string dir_;       // SSTable文件存储目录
+    uint64_t time_stamp_;   // 最新SST文件的时间戳，越新的SST文件时间戳越大
+    uint64_t wal_num_;      // 当前WAL文件的序号
+    // 已经写入MemTable的最大序列号，不加快照的读取以它为读取的序列号。
+    // 只有组提交的leader会修改，同一组的写入全部完成后才更新，读线程不会看到写了一半的组
+    std::atomic<SequenceNumber> last_sequence_;
+    SnapshotList snapshots_;        // 存活的快照
+    std::mutex snapshot_mutex_;     // 保护snapshots_
+    options::WalSyncMode wal_sync_mode_;    // WAL的刷盘策略
+    options::CompactionStyle compaction_style_;     // compaction策略
+    std::unique_ptr<WalWriter> wal_;        // mem_table_对应的WAL文件
+    FileCache file_cache_{options::kMaxOpenFiles};  // 已打开的SST文件，所有TableCache共享
+    BlockCache block_cache_{options::kBlockCacheCapacity, options::kBlockCacheShardBits};  // SST数据块缓存，所有TableCache共享
+    // flush和compaction写SST文件的限速器，flush以高优先级申请令牌
+    RateLimiter rate_limiter_{options::kRateLimitBytesPerSec, options::kRateLimiterRefillPeriodUs,
+                              options::kRateLimiterMaxBorrowPeriods};
     std::vector<int> level_num_vec_;    // 记录每一层的文件数目
     std::vector<std::set<TableCache>> sstable_meta_info_;   // 记录所有SSTable文件的元信息
-    mode kvstore_mode_; // 存储引擎工作模式
+
+    /**
+     * @brief 一层SST文件的查找结构
+     * @details level0的文件key范围可能重叠，按时间戳从新到旧排列，依次查找；其他层的文件key范围不重叠，
+     *          按key从小到大排列，max_keys[i]为files[i]的最大key，二分查找后至多查找一个文件
+     */
+    struct LevelFiles {
+        std::vector<TableCache> files;
+        std::vector<int64_t> max_keys;
+    };
+    std::vector<LevelFiles> level_files_;   // 每一层的查找结构，由meta_mutex_保护
+    std::vector<bool> compacting_levels_;   // 每一层是否正在被compaction任务合并
+    int bg_compactions_;                    // 已提交且未结束的compaction任务数
     ThreadPool pool_{4};    // 线程池，处理器内核总数为4，线程数量设置为4
+    ThreadPool read_pool_{options::kMultiGetThreads};  // MultiGet并行读取SST文件的线程池
     cache_t<uint64_t, std::string> cache_;  // 缓存器
 
     // 同步与互斥相关
-    std::condition_variable cond_var_;
-    std::mutex mutex_;
-    std::shared_mutex rw_mutex_;
+    // 加锁顺序：rw_mutex_ -> mutex_，rw_mutex_ -> meta_mutex_
+    std::condition_variable cond_var_;  // immutable_tables_出队、flush任务结束时通知
+    std::mutex mutex_;                  // 保护flush_scheduled_，与rw_mutex_一起保护immutable_tables_
+    std::shared_mutex rw_mutex_;        // 保护mem_table_和immutable_tables_的切换
+    std::shared_mutex meta_mutex_;      // 保护sstable_meta_info_、level_num_vec_、compacting_levels_和bg_compactions_
+    std::condition_variable_any bg_cv_; // compaction任务结束时通知，与meta_mutex_一起使用
+    std::deque<Writer *> writers_;      // 等待组提交的写请求队列
+    std::mutex writers_mutex_;          // 保护writers_
+
+    // 后台线程池，最后声明从而最先析构，析构前所有任务都已结束
+    ThreadPool flush_pool_{1};          // flush线程池，高优先级，只有一个线程
+    // 执行compaction子任务的线程池，第一个子任务在compaction线程中执行，在compaction_pool_之后析构
+    ThreadPool subcompaction_pool_{options::kMaxSubcompactions - 1, options::kCompactionThreadNice};
+    ThreadPool compaction_pool_{options::kMaxBackgroundCompactions, options::kCompactionThreadNice};   // compaction线程池，低优先级
 };
 
 #endif // !LSMKVSTORE_KVSTORE_H_
\ No newline at end of file
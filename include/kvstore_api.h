@@ -3,6 +3,12 @@
 
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "iterator.h"
+#include "snapshot.h"
 
 /**
  * @brief 存储引擎向外部提供的API类
@@ -29,9 +35,10 @@ public:
     /**
      * @brief 查找键值对
      * @param[in] key 要查找的key
+     * @param[in] snapshot 读取的快照，为nullptr时读取最新的数据
      * @return std::string 返回key对应的val，如果key不存在，返回""
      */
-    virtual std::string Get(uint64_t key) = 0;
+    virtual std::string Get(uint64_t key, const Snapshot *snapshot = nullptr) = 0;
 
     /**
      * @brief 删除键值对
@@ -40,6 +47,38 @@ public:
      */
     virtual bool Del(uint64_t key, bool to_cache = false) = 0;
 
+    /**
+     * @brief 创建一个按key有序遍历所有键值对的迭代器
+     * @details 迭代器只能看到snapshot(为nullptr时为创建时刻)之前的写入，
+     *          之后的写入和compaction都不影响遍历结果
+     * @param[in] snapshot 读取的快照
+     * @return 新建的迭代器，使用前需要先调用Seek系列函数定位
+     */
+    virtual std::unique_ptr<Iterator> NewIterator(const Snapshot *snapshot = nullptr) = 0;
+
+    /**
+     * @brief 范围查询
+     * @param[in] lo 范围的下界(包含)
+     * @param[in] hi 范围的上界(包含)
+     * @param[in] limit 最多返回的键值对个数
+     * @param[in] snapshot 读取的快照，为nullptr时读取最新的数据
+     * @return 按key从小到大排列的键值对
+     */
+    virtual std::vector<std::pair<uint64_t, std::string>> Scan(uint64_t lo, uint64_t hi, size_t limit,
+                                                               const Snapshot *snapshot = nullptr) = 0;
+
+    /**
+     * @brief 创建当前时刻的快照
+     * @details 用快照读取时看不到快照创建之后的写入。快照不再使用时需要调用ReleaseSnapshot释放，
+     *          否则compaction会一直保留对它可见的旧版本
+     */
+    virtual const Snapshot *GetSnapshot() = 0;
+
+    /**
+     * @brief 释放GetSnapshot创建的快照
+     */
+    virtual void ReleaseSnapshot(const Snapshot *snapshot) = 0;
+
     /**
      * @brief 重置kvstore
      * @details 移除所有键值对元素，包括Memtable、Immutable Memtable和所有SSTable文件
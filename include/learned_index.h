@@ -0,0 +1,59 @@
+#ifndef LSMKVSTORE_LEARNED_INDEX_H_
+#define LSMKVSTORE_LEARNED_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 学习索引的格式：| segment 0 | ... | segment m-1 | error(4B) | m(4B) |
+// 每个segment为：| first_key(8B) | slope(8B, double) | base(4B) |，表示从key为first_key、
+// 序号为base的点开始的一条直线，对[first_key, 下一个segment的first_key)中的key预测序号
+// base + slope * (key - first_key)。构建时保证每个点的预测值与实际序号相差不超过error
+
+/**
+ * @brief 分段线性的学习索引，用于预测一个有序的int64_t数组中key的位置
+ * @details key接近连续时整个数组只需要很少的几段直线，内存占用比保存所有key小几个数量级。
+ *          查找时先二分找到key所在的段，计算预测值，再只在误差范围内查找
+ */
+class LearnedIndex {
+public:
+    LearnedIndex() : error_(0) {}
+
+    /**
+     * @brief 解析Build生成的内容，格式错误时为空
+     */
+    explicit LearnedIndex(const std::string &contents);
+
+    /**
+     * @brief 用贪心的收缩锥算法为有序数组生成尽量少的段
+     * @param[in] keys 从小到大排列的key，可以有重复
+     * @param[in] error 允许的最大预测误差
+     * @return 学习索引的内容，keys为空时返回空字符串
+     */
+    static std::string Build(const std::vector<int64_t> &keys, uint32_t error);
+
+    /**
+     * @brief 预测第一个不小于key的元素的序号所在的范围
+     * @details 浮点运算的误差或重复的key可能使结果不在范围内，调用者需要验证，失败时退回完整的查找
+     * @param[in] n 数组的长度
+     * @param[out] lo,hi 结果在[lo, hi]之间(结果可能为n)，只需要在[lo, hi)中查找
+     */
+    void Predict(int64_t key, size_t n, size_t *lo, size_t *hi) const;
+
+    bool Empty() const { return segments_.empty(); }
+    size_t NumSegments() const { return segments_.size(); }
+    size_t MemoryUsage() const { return segments_.capacity() * sizeof(Segment); }
+
+private:
+    struct Segment {
+        int64_t first_key;
+        double slope;
+        uint32_t base;
+    };
+
+    std::vector<Segment> segments_;
+    uint32_t error_;
+};
+
+#endif // !LSMKVSTORE_LEARNED_INDEX_H_
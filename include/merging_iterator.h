@@ -0,0 +1,71 @@
+#ifndef LSMKVSTORE_MERGING_ITERATOR_H_
+#define LSMKVSTORE_MERGING_ITERATOR_H_
+
+#include <vector>
+#include <memory>
+
+#include "iterator.h"
+
+/**
+ * @brief 将多个有序迭代器归并成一个有序迭代器
+ * @details children中下标越小的迭代器数据越新。多个迭代器中出现同一个key时只输出最新的那个，
+ *          其余的被跳过。正向和反向遍历分别使用小顶堆和大顶堆，遍历方向改变时重新定位所有子迭代器
+ */
+class MergingIterator : public InternalIterator {
+public:
+    explicit MergingIterator(std::vector<std::unique_ptr<InternalIterator>> children);
+
+    bool Valid() const override { return current_ != nullptr; }
+    void SeekToFirst() override;
+    void SeekToLast() override;
+    void Seek(int64_t key) override;
+    void Next() override;
+    void Prev() override;
+    int64_t Key() const override { return current_->Key(); }
+    std::string Value() const override { return current_->Value(); }
+    ValueType Type() const override { return current_->Type(); }
+
+private:
+    enum Direction { kForward, kReverse };
+
+    // 用所有有效的子迭代器重建堆，并取堆顶作为当前位置
+    void RebuildHeap(Direction direction);
+    // 弹出堆顶作为当前位置
+    void PopCurrent();
+    // 将key等于current_的子迭代器全部向前(正向)或向后(反向)移动一步后放回堆中
+    void AdvanceEqual();
+    // 堆的比较函数，返回true表示a应该排在b的下面
+    bool Compare(size_t a, size_t b) const;
+
+    std::vector<std::unique_ptr<InternalIterator>> children_;
+    std::vector<size_t> heap_;      // 除current_外所有有效子迭代器的下标
+    InternalIterator *current_;
+    size_t current_index_;
+    Direction direction_;
+};
+
+/**
+ * @brief 存储引擎对外提供的迭代器
+ * @details 在MergingIterator的基础上跳过删除标记，只输出仍然存在的键值对
+ */
+class StoreIterator : public Iterator {
+public:
+    explicit StoreIterator(std::unique_ptr<InternalIterator> iter) : iter_(std::move(iter)) {}
+
+    bool Valid() const override { return iter_->Valid(); }
+    void SeekToFirst() override { iter_->SeekToFirst(); SkipDeletedForward(); }
+    void SeekToLast() override { iter_->SeekToLast(); SkipDeletedBackward(); }
+    void Seek(int64_t key) override { iter_->Seek(key); SkipDeletedForward(); }
+    void Next() override { iter_->Next(); SkipDeletedForward(); }
+    void Prev() override { iter_->Prev(); SkipDeletedBackward(); }
+    int64_t Key() const override { return iter_->Key(); }
+    std::string Value() const override { return iter_->Value(); }
+
+private:
+    void SkipDeletedForward();
+    void SkipDeletedBackward();
+
+    std::unique_ptr<InternalIterator> iter_;
+};
+
+#endif // !LSMKVSTORE_MERGING_ITERATOR_H_
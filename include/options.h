@@ -2,23 +2,153 @@
 #define LSMKVSTORE_OPTIONS_H_
 
 #include <math.h>
+#include <string>
+#include <cstddef>
+
+#include "compression.h"
 
 namespace options {
 
-// 删除标记
-const std::string kDelSign = "~DELETED~";
+// 布隆过滤器中每个key占用的位数，误判率约为0.6185^kBloomBitsPerKey，10位时约为1%
+const int kBloomBitsPerKey = 10;
+
+// 是否使用分块的布隆过滤器：每个key的所有探测位于同一个64字节的块中，一次查询只访问一个cache line，
+// 支持AVX2时用SIMD完成探测。误判率比标准格式略高
+const bool kBlockedBloomFilter = true;
+
+// SST文件中数据块的目标大小，一次查找只读取一个数据块
+const int kBlockSize = 4096;
+
+// level0的数据块使用的压缩算法。level0的文件很快会被合并，不压缩以减少flush的CPU开销
+const CompressionType kL0Compression = kNoCompression;
+
+// level1到倒数第二层的数据块使用的压缩算法
+const CompressionType kCompression = kFastCompression;
+
+// 最后一层的数据块使用的压缩算法，最后一层保存了大部分数据，使用压缩率更高的算法。
+// 当前构建不支持时使用kFastCompression
+const CompressionType kBottommostCompression = kZstdCompression;
+
+// 压缩后的数据块至少要比原始内容小1/8，否则保存原始内容
+const int kMinCompressionSavingShift = 3;
+
+// 是否在SST文件中保存学习索引：用分段线性函数拟合各数据块最后一条记录的key，查找时预测数据块的序号。
+// key接近连续时只需要很少的几段。默认关闭，使用Eytzinger数组查找
+const bool kLearnedIndex = false;
+
+// 学习索引允许的最大预测误差(数据块数)，查找时在预测值前后各kLearnedIndexError + 1个数据块中二分
+const int kLearnedIndexError = 4;
+
+// 数据块中每隔多少条记录设置一个重启点
+const int kBlockRestartInterval = 16;
+
+// 同时保持打开的SST文件数上限，超过时关闭最久未使用的文件
+const int kMaxOpenFiles = 500;
 
-// SST文件中的时间戳、元素个数、min_key、max_key、布隆过滤器加起来的总字节数
-const int kInitialSize = 10272;
+// SST数据块缓存的容量(字节)
+const size_t kBlockCacheCapacity = 64 << 20;
 
-// 每层的SST文件数量上限
-inline int SSTMaxNumForLevel(int i) {
-    return pow(2, i + 1);
+// 数据块缓存分片数的对数，每个分片有独立的锁
+const int kBlockCacheShardBits = 4;
+
+// 迭代器(包括Scan)读取的数据块是否放入数据块缓存。遍历大量数据时放入会冲掉点查询的热点数据块
+const bool kIteratorFillCache = false;
+
+/**
+ * @brief 写入某一层的SST文件时数据块使用的压缩算法
+ * @param[in] level 文件所在的层
+ * @param[in] bottommost 是否是目前的最后一层
+ */
+inline CompressionType CompressionForLevel(int level, bool bottommost) {
+    CompressionType type = (level == 0) ? kL0Compression : (bottommost ? kBottommostCompression : kCompression);
+    return CompressionSupported(type) ? type : kFastCompression;
 }
 
-// SST文件的大小上限
+// 是否使用io_uring批量提交SST文件的读请求和异步提交写请求，内核不支持时自动使用pread/pwrite
+const bool kUseIoUring = true;
+
+// 每个io_uring实例同时进行的请求数上限(队列深度)
+const int kIoQueueDepth = 32;
+
+// compaction顺序读取每个输入文件时一次预读的字节数上限(至少读取一个数据块，最多options::kIoQueueDepth个)。
+// 预读的数据块保持压缩状态，用到时才解压，compaction的内存占用约为输入文件数乘以该值
+const size_t kCompactionReadaheadSize = 256 << 10;
+
+// 写SST文件时缓冲区的大小，缓冲区满时作为一个写请求提交
+const size_t kWritableFileBufferSize = 256 << 10;
+
+// 后台写入(flush和compaction)的基础限速(字节/秒)，为0时不限速
+const int64_t kRateLimitBytesPerSec = 128 << 20;
+
+// 待完成的compaction数据量从0增加到kRateLimitDebtForMaxBytes时，限速从kRateLimitBytesPerSec
+// 线性提高到kRateLimitMaxBytesPerSec，避免compaction落后太多导致写入停顿
+const int64_t kRateLimitMaxBytesPerSec = 1024 << 20;
+const uint64_t kRateLimitDebtForMaxBytes = 256 << 20;
+
+// 限速器的补充周期(微秒)，令牌最多积累一个周期的量
+const int64_t kRateLimiterRefillPeriodUs = 100 * 1000;
+
+// flush的写入最多透支的补充周期数，透支的令牌由之后的compaction写入偿还
+const int kRateLimiterMaxBorrowPeriods = 10;
+
+// MultiGet并行读取SST文件的线程数
+const int kMultiGetThreads = 4;
+
+// SST文件的大小上限，也是memtable在Arena中占用内存的上限
 const int kMemTable = (int)pow(2, 21);
 
+// 层数，最后一层为kNumLevels - 1。已有文件的层数更多时以已有的层数为准
+const int kNumLevels = 7;
+
+// level0的SST文件数达到该值时，将level0的所有文件合并到基础层。universal模式下为触发合并的有序序列数
+const int kL0CompactionTrigger = 4;
+
+// 基础层的目标大小(字节)。level1及以上各层按SST文件的总大小限制，
+// 下一层的目标大小是上一层的kLevelSizeMultiplier倍
+const uint64_t kMaxBytesForLevelBase = 4 * (uint64_t)kMemTable;
+const int kLevelSizeMultiplier = 10;
+
+// compaction策略
+enum class CompactionStyle {
+    kLevel,         // leveled：level1及以上每层是一个有序序列，超过目标大小时选择一个文件与下一层有交集的文件合并
+    kUniversal      // universal(分级)：大小相近的有序序列整体合并，写放大小，读放大和空间放大较大
+};
+
+// 默认的compaction策略
+const CompactionStyle kCompactionStyle = CompactionStyle::kLevel;
+
+// universal模式下，下一个序列的大小不超过已选序列总大小的(100 + kUniversalSizeRatio)%时一起合并
+const int kUniversalSizeRatio = 1;
+
+// universal模式下按大小比例合并时，一次至少合并的有序序列数
+const int kUniversalMinMergeWidth = 2;
+
+// universal模式下，除最旧序列外的总大小超过最旧序列的该百分比时合并所有序列，限制空间放大
+const int kUniversalMaxSizeAmplificationPercent = 200;
+
+// 为false时基础层为level1，level i的目标大小为kMaxBytesForLevelBase * kLevelSizeMultiplier^(i-1)。
+// 为true时从最大一层的实际大小开始，每向上一层除以kLevelSizeMultiplier，直到不超过kMaxBytesForLevelBase，
+// 该层作为基础层，level0直接合并到基础层，上面的空层被跳过。数据量较小时只有最后几层有数据，
+// 空间放大约为1 + 1/kLevelSizeMultiplier
+const bool kLevelCompactionDynamicLevelBytes = true;
+
+// MemTable总数的上限（包括正在写入的MemTable和等待flush的immutable MemTable）
+const int kMaxWriteBufferNumber = 4;
+
+// 后台compaction线程数。每一层的compaction是一个独立的任务，超过上限的层越多，
+// 同时进行的任务越多，最多为该值
+const int kMaxBackgroundCompactions = 2;
+
+// 一次compaction最多切分成的子任务数。输入文件的总大小达到几个SST文件时，
+// 按key范围切分，各子任务并行归并
+const int kMaxSubcompactions = 4;
+
+// compaction线程的nice值，使flush和前台读写线程优先被调度
+const int kCompactionThreadNice = 10;
+
+// level0的SST文件数达到该值时flush等待compaction，写入随之被immutable memtable队列阻塞
+const int kL0StopWritesTrigger = 8;
+
 // 缓存策略（FIFO、LRU、LFU三选一）
 // #define FIFO
 #define LRU
@@ -27,6 +157,25 @@ const int kMemTable = (int)pow(2, 21);
 // 缓存容量，可以缓存多少对键值对
 const int kCacheCap = 100;
 
+// WAL的刷盘策略
+enum class WalSyncMode {
+    kNoSync,            // 只write，何时落盘由操作系统决定
+    kSyncEveryWrite,    // 每次组提交都fdatasync
+    kSyncInterval       // 后台线程每隔kWalSyncIntervalMs毫秒fdatasync一次
+};
+
+// 默认的WAL刷盘策略
+const WalSyncMode kWalSyncMode = WalSyncMode::kSyncEveryWrite;
+
+// kSyncInterval模式下的刷盘间隔（毫秒）
+const int kWalSyncIntervalMs = 100;
+
+// 一次组提交最多合并的字节数
+const size_t kMaxGroupCommitSize = 1 << 20;
+
+// 组提交中的写请求是否并发地写入MemTable（各写请求的key没有重叠时才会并发）
+const bool kAllowConcurrentMemTableWrite = true;
+
 }       // namespace options
 
 #endif // !LSMKVSTORE_OPTIONS_H_
\ No newline at end of file
@@ -0,0 +1,67 @@
+#ifndef LSMKVSTORE_RATE_LIMITER_H_
+#define LSMKVSTORE_RATE_LIMITER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+/**
+ * @brief 后台写入的优先级
+ */
+enum class IoPriority {
+    kLow,   // compaction
+    kHigh   // flush，可以透支令牌，并且先于等待中的低优先级请求获得令牌
+};
+
+/**
+ * @brief 后台写入的令牌桶限速器
+ * @details 令牌按bytes_per_second的速度持续补充，最多积累一个补充周期的量。低优先级请求在令牌数为正
+ *          且没有等待中的高优先级请求时获得令牌；高优先级请求在透支不超过max_borrow_periods个补充周期的量时
+ *          立即获得令牌。获得令牌后减去请求的字节数，令牌数可以为负，由之后补充的令牌偿还，长期的平均速度
+ *          不超过bytes_per_second。线程安全
+ */
+class RateLimiter {
+public:
+    /**
+     * @param[in] bytes_per_second 每秒补充的令牌数(字节)，不大于0时不限速
+     * @param[in] refill_period_us 补充周期(微秒)，决定令牌最多积累的量
+     * @param[in] max_borrow_periods 高优先级请求最多透支的补充周期数
+     */
+    RateLimiter(int64_t bytes_per_second, int64_t refill_period_us, int max_borrow_periods);
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter &operator=(const RateLimiter &) = delete;
+
+    /**
+     * @brief 申请写入bytes个字节，令牌不足时阻塞
+     */
+    void Request(size_t bytes, IoPriority priority);
+
+    /**
+     * @brief 修改限速，等待中的请求按新的速度重新计算等待时间
+     */
+    void SetBytesPerSecond(int64_t bytes_per_second);
+    int64_t GetBytesPerSecond() const;
+
+    // 某个优先级已申请的总字节数
+    uint64_t GetTotalBytes(IoPriority priority) const;
+
+private:
+    // 按经过的时间补充令牌。调用者需持有mutex_
+    void Refill();
+    // 一个补充周期的令牌数。调用者需持有mutex_
+    double PeriodBytes() const { return (double)bytes_per_second_ * refill_period_us_ / 1000000; }
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;    // 高优先级请求获得令牌、修改限速时通知
+    int64_t bytes_per_second_;
+    int64_t refill_period_us_;
+    int max_borrow_periods_;
+    double available_;              // 当前的令牌数，可以为负
+    std::chrono::steady_clock::time_point last_refill_;
+    int high_waiters_;              // 等待中的高优先级请求数
+    uint64_t total_bytes_[2];       // 以IoPriority为下标
+};
+
+#endif // !LSMKVSTORE_RATE_LIMITER_H_
@@ -7,71 +7,175 @@
 #include <iostream>
 #include <bitset>
 #include <string.h>
+#include <atomic>
+#include <memory>
 
 #include "options.h"
 #include "murmurhash3.h"
+#include "arena.h"
+#include "iterator.h"
+#include "dbformat.h"
+#include "rate_limiter.h"
 
+/**
+ * @brief 跳表节点
+ * @details 节点和它的value在Arena上一次分配：节点头之后是变长的next_指针数组(长度为节点高度)，
+ *          再之后是value记录(4字节长度 + value内容)。每次写入都插入一个新节点，
+ *          节点链接完成后不再修改，读线程无需加锁
+ */
 struct Node {
     int64_t key_;
-    std::string val_;
-    Node *right_, *down_;
-    Node(int64_t key, const std::string &val, Node *right, Node *down)
-        : key_(key), val_(val), right_(right), down_(down) {}
-    Node() : key_(INT64_MIN), val_(""), right_(nullptr), down_(nullptr) {}
+    SequenceNumber seq_;                // 写入该版本的序列号
+    ValueType type_;                    // 版本的类型，删除标记的value为空
+    const char *val_;                   // value记录的起始位置
+    std::atomic<Node *> next_[1];       // 每一层的后继节点，实际长度为节点高度
+
+    Node *Next(int level) const { return next_[level].load(std::memory_order_acquire); }
+    void SetNext(int level, Node *x) { next_[level].store(x, std::memory_order_release); }
+    Node *NoBarrierNext(int level) const { return next_[level].load(std::memory_order_relaxed); }
+    void NoBarrierSetNext(int level, Node *x) { next_[level].store(x, std::memory_order_relaxed); }
+    bool CASNext(int level, Node *expected, Node *x) {
+        return next_[level].compare_exchange_strong(expected, x);
+    }
+
+    InternalKey GetInternalKey() const { return InternalKey{key_, seq_, type_}; }
+    uint32_t GetValLen() const {
+        uint32_t len;
+        memcpy(&len, val_, sizeof(uint32_t));
+        return len;
+    }
+    std::string GetVal() const { return std::string(val_ + sizeof(uint32_t), GetValLen()); }
 };
 
+/**
+ * @brief 支持并发写入的跳表，作为MemTable
+ * @details 参照LevelDB/RocksDB的InlineSkipList：每一层的链接都通过CAS完成，
+ *          多个线程可以同时调用Put；读线程无需加锁即可遍历，不会看到未链接完成的节点。
+ *          节点按内部键(key升序，序列号降序)排列，同一个key的每个版本都是一个节点。
+ *          节点不会被删除，所有内存随跳表析构一次性释放
+ */
 class SkipList {
 public:
-    size_t memory_;     // 转换成SSTable占用的空间大小
-
-public:
-    SkipList()
-        : size_(0),
-          head_(nullptr),
-          memory_(options::kInitialSize),
-          time_stamp_(0),
-          min_key_(INT64_MAX),
-          max_key_(INT64_MIN) {}
+    SkipList();
+    SkipList(const SkipList &) = delete;
+    SkipList &operator=(const SkipList &) = delete;
 
-    ~SkipList();
+    // 所有节点都在arena_上，随arena_一次性释放
+    ~SkipList() = default;
 
     /**
-     * @brief 查找键值对
+     * @brief 查找key对seq可见的最新版本
      * @param[in] key 查找键值对的键值
-     * @return string 返回key对应的val，如果key不存在则返回""
+     * @param[in] seq 读取的序列号，只能看到序列号不大于seq的版本
+     * @param[out] type 找到的版本的类型
+     * @param[out] val 找到的版本的value，删除标记为空
+     * @return true找到可见的版本(包括删除标记)，false跳表中没有该key的可见版本
      */
-    std::string Get(int64_t key) const;
+    bool Get(int64_t key, SequenceNumber seq, ValueType *type, std::string *val) const;
 
     /**
-     * @brief 插入键值对
+     * @brief 插入一个版本的键值对，可以被多个线程并发调用
      * @param[in] key 键
+     * @param[in] seq 序列号，(key, seq)不能重复
+     * @param[in] type 类型，删除标记的val为空
      * @param[in] val 值
      */
-    void Put(int64_t key, const std::string &val);
+    void Put(int64_t key, SequenceNumber seq, ValueType type, const std::string &val);
 
     /**
      * @brief 将MemTable储存为L0层SSTable, Minor MinorCompaction
-     * @param[in] num
-     * @param[in] dir
+     * @details 调用时不能有并发的Put。一个key的旧版本只有对某个快照可见时才会写入文件
+     * @param[in] num SST文件序号
+     * @param[in] dir SST文件所在目录
+     * @param[in] time_stamp SST文件的时间戳
+     * @param[in] smallest_snapshot 最旧的快照的序列号，没有快照时为当前最新的序列号
+     * @param[in] rate_limiter 写入文件的限速器，以高优先级申请令牌，为nullptr时不限速
+     * @return 文件是否完整写入并刷盘
      */
-    void Store(int num, const std::string &dir);
+    bool Store(int num, const std::string &dir, uint64_t time_stamp, SequenceNumber smallest_snapshot,
+               RateLimiter *rate_limiter = nullptr);
 
     /**
-     * @brief 获取第一个节点
+     * @brief 获取第一个数据节点，跳表为空时返回nullptr
      */
     Node *GetFirstNode() const;
 
     /**
-     * @brief 获取储存的键值对个数
+     * @brief 获取储存的版本个数
+     */
+    size_t GetSize() const { return size_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 获取跳表实际占用的内存大小
+     */
+    size_t ApproximateMemoryUsage() const { return arena_.MemoryUsage(); }
+
+private:
+    friend class MemTableIterator;
+
+    static const int kMaxHeight = 12;       // 最大层数
+    static const int kBranching = 4;        // 每向上一层节点数减少为1/kBranching
+
+    // 在arena_上分配一个高度为height的节点，value记录紧跟在next_数组之后
+    Node *NewNode(int64_t key, SequenceNumber seq, ValueType type, const std::string &val, int height);
+
+    // 随机生成新节点的高度，线程安全
+    static int RandomHeight();
+
+    // 返回第一个内部键大于等于ikey的节点
+    Node *FindGreaterOrEqual(const InternalKey &ikey) const;
+
+    // 返回最后一个内部键小于ikey的节点，不存在时返回head_
+    Node *FindLessThan(const InternalKey &ikey) const;
+
+    // 返回最后一个节点，跳表为空时返回head_
+    Node *FindLast() const;
+
+    /**
+     * @brief 从before开始，在level层查找ikey的插入位置
+     * @param[out] prev 最后一个内部键小于ikey的节点
+     * @param[out] next 第一个内部键大于等于ikey的节点
      */
-    size_t GetSize() const { return size_; }
+    void FindSpliceForLevel(const InternalKey &ikey, Node *before, int level, Node **prev, Node **next) const;
+
+    Arena arena_;                       // 节点和value的内存池，支持并发分配
+    std::atomic<uint64_t> size_;        // 储存的版本个数
+    Node *head_;                        // 头节点，高度为kMaxHeight
+    std::atomic<int> max_height_;       // 当前最大层数
+    uint64_t time_stamp_;               // 时间戳，即SSTable序号
+    std::atomic<int64_t> min_key_;      // 最小key
+    std::atomic<int64_t> max_key_;      // 最大key
+};
+
+/**
+ * @brief MemTable的迭代器
+ * @details 只输出每个key对seq可见的最新版本。持有跳表的shared_ptr，迭代期间跳表不会被释放；
+ *          可以与并发的Put同时进行，序列号大于seq的新写入不会被遍历到
+ */
+class MemTableIterator : public InternalIterator {
+public:
+    MemTableIterator(std::shared_ptr<SkipList> table, SequenceNumber seq)
+        : table_(std::move(table)), seq_(seq), node_(nullptr) {}
+
+    bool Valid() const override { return node_ != nullptr; }
+    void SeekToFirst() override;
+    void SeekToLast() override;
+    void Seek(int64_t key) override;
+    void Next() override;
+    void Prev() override;
+    int64_t Key() const override { return node_->key_; }
+    std::string Value() const override { return node_->GetVal(); }
+    ValueType Type() const override { return node_->type_; }
 
 private:
-    uint64_t size_;                  // 储存的键值对个数
-    Node *head_;                    // 头节点
-    uint64_t time_stamp_; // 时间戳，即SSTable序号
-    int64_t min_key_;           // 最小key
-    int64_t max_key_;          // 最大key
+    // 从node开始向后找到第一个可见的版本
+    void FindNextVisible(Node *node);
+    // 从node开始向前找到最后一个key的可见版本
+    void FindPrevVisible(Node *node);
+
+    std::shared_ptr<SkipList> table_;
+    SequenceNumber seq_;    // 读取的序列号
+    Node *node_;            // 当前节点，为nullptr时迭代器无效
 };
 
 #endif // !LSMKVSTORE_SKIPLIST_H_
\ No newline at end of file
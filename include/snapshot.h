@@ -0,0 +1,62 @@
+#ifndef LSMKVSTORE_SNAPSHOT_H_
+#define LSMKVSTORE_SNAPSHOT_H_
+
+#include "dbformat.h"
+
+/**
+ * @brief 快照，记录创建时刻最新的序列号
+ * @details 用快照读取时只能看到序列号不大于它的写入。快照存活期间，
+ *          compaction会保留对它可见的旧版本
+ */
+class Snapshot {
+public:
+    SequenceNumber GetSequence() const { return seq_; }
+
+private:
+    friend class SnapshotList;
+
+    Snapshot() : seq_(0), prev_(this), next_(this) {}
+    explicit Snapshot(SequenceNumber seq) : seq_(seq), prev_(nullptr), next_(nullptr) {}
+
+    SequenceNumber seq_;
+    Snapshot *prev_;
+    Snapshot *next_;
+};
+
+/**
+ * @brief 所有存活的快照组成的双向循环链表，按创建顺序(序列号从小到大)排列
+ * @details 不是线程安全的，由KVStore加锁保护
+ */
+class SnapshotList {
+public:
+    SnapshotList() = default;
+    SnapshotList(const SnapshotList &) = delete;
+    SnapshotList &operator=(const SnapshotList &) = delete;
+    ~SnapshotList() {
+        while (!Empty()) Delete(Oldest());
+    }
+
+    bool Empty() const { return head_.next_ == &head_; }
+    const Snapshot *Oldest() const { return head_.next_; }
+
+    // 创建序列号为seq的快照，seq不能小于已有快照的序列号
+    const Snapshot *New(SequenceNumber seq) {
+        Snapshot *s = new Snapshot(seq);
+        s->next_ = &head_;
+        s->prev_ = head_.prev_;
+        s->prev_->next_ = s;
+        s->next_->prev_ = s;
+        return s;
+    }
+
+    void Delete(const Snapshot *s) {
+        s->prev_->next_ = s->next_;
+        s->next_->prev_ = s->prev_;
+        delete s;
+    }
+
+private:
+    Snapshot head_;     // 哨兵节点
+};
+
+#endif // !LSMKVSTORE_SNAPSHOT_H_
@@ -0,0 +1,111 @@
+#ifndef LSMKVSTORE_TABLE_BUILDER_H_
+#define LSMKVSTORE_TABLE_BUILDER_H_
+
+#include <string>
+#include <cstdint>
+#include <vector>
+
+#include "block.h"
+#include "bloom_filter.h"
+#include "compression.h"
+#include "dbformat.h"
+#include "io_backend.h"
+#include "options.h"
+
+// SST文件格式：
+// | data block 0 | ... | data block n-1 | bloom filter | learned index | index | footer(80B) |
+// 数据块的格式见block.h，大小约为options::kBlockSize(压缩前)，记录按内部键从小到大排列。
+// 每个数据块在文件中保存为：| contents | compression_type(1B) |，contents为压缩后的内容，
+// compression_type见compression.h。压缩效果不明显时保存原始内容，类型为kNoCompression。
+// 布隆过滤器的格式见bloom_filter.h，大小由文件中不同key的个数和options::kBloomBitsPerKey决定。
+// 学习索引的格式见learned_index.h，拟合各数据块最后一条记录的key，位于布隆过滤器和索引区之间，
+// 长度为index_offset - filter_offset - filter_size，为0表示没有学习索引。
+// 索引区为每个数据块一项：| last_key(8B) | tag(8B) | offset(4B) | size(4B) |，
+// last_key和tag是该数据块最后一条记录的内部键。
+// footer：| filter_offset(8B) | filter_size(8B) | index_offset(8B) | num_blocks(8B) | time_stamp(8B) |
+//         | num_pair(8B) | min_key(8B) | max_key(8B) | max_seq(8B) | magic(8B) |
+// 读取时只需要把footer、布隆过滤器、学习索引和索引区读入内存，查找时再读取一个数据块
+
+// footer的字节数
+const int kFooterSize = 80;
+
+// 索引区中每一项的字节数
+const int kBlockIndexEntrySize = 24;
+
+// 数据块末尾压缩类型的字节数
+const int kBlockTrailerSize = 1;
+
+// footer末尾的魔数，用于识别SST文件格式
+const uint64_t kTableMagicNumber = 0x4c534d4b56424c4bULL;
+
+/**
+ * @brief 数据块在文件中的位置，以及块内最后一条记录的内部键。size包括末尾的压缩类型
+ */
+struct BlockHandle {
+    InternalKey last_key;
+    uint32_t offset;
+    uint32_t size;
+};
+
+/**
+ * @brief 生成一个SST文件
+ * @details 记录必须按内部键从小到大的顺序加入，同一个key的所有版本相邻
+ */
+class TableBuilder {
+public:
+    /**
+     * @param[in] file_name SST文件名
+     * @param[in] time_stamp 写入文件的时间戳
+     * @param[in] compression 数据块使用的压缩算法，必须是当前构建支持的算法
+     * @param[in] rate_limiter 写入文件的限速器，为nullptr时不限速
+     * @param[in] priority 向rate_limiter申请令牌的优先级
+     */
+    TableBuilder(const std::string &file_name, uint64_t time_stamp, CompressionType compression = kNoCompression,
+                 RateLimiter *rate_limiter = nullptr, IoPriority priority = IoPriority::kLow);
+    TableBuilder(const TableBuilder &) = delete;
+    TableBuilder &operator=(const TableBuilder &) = delete;
+
+    /**
+     * @brief 加入一个版本的键值对，当前数据块达到options::kBlockSize时写入文件
+     */
+    void Add(const InternalKey &ikey, const char *val, size_t len);
+    void Add(const InternalKey &ikey, const std::string &val) { Add(ikey, val.data(), val.size()); }
+
+    /**
+     * @brief 写入最后一个数据块、布隆过滤器、索引区和footer，刷盘后关闭文件
+     * @return 文件是否完整写入并刷盘，失败时调用者应删除该文件
+     */
+    bool Finish();
+
+    uint64_t NumEntries() const { return num_pair_; }
+
+    /**
+     * @brief 估算Finish后的文件大小
+     * @details 已写入的数据块按压缩后的大小计算，再加上当前数据块(压缩前)、布隆过滤器、索引区和footer，
+     *          不含学习索引。与compaction按文件大小计算的各层大小使用同一个单位
+     */
+    uint64_t FileSize() const {
+        return offset_ + block_.CurrentSize() + filter_keys_.size() * options::kBloomBitsPerKey / 8 +
+               (index_.size() + 1) * kBlockIndexEntrySize + kFooterSize;
+    }
+
+private:
+    // 将当前数据块写入文件并记录它的索引项
+    void FlushBlock();
+
+    WritableFile file_;                 // 写入通过IoBackend异步提交
+    uint64_t offset_;                   // 已写入文件的字节数
+    uint64_t time_stamp_;
+    CompressionType compression_;
+    std::string compressed_;            // 压缩数据块的缓冲区
+    uint64_t num_pair_;
+    int64_t min_key_;
+    int64_t max_key_;
+    SequenceNumber max_seq_;
+    InternalKey last_key_;              // 最后加入的内部键
+    BlockBuilder block_;
+    std::vector<BlockHandle> index_;
+    std::vector<int64_t> filter_keys_;  // 所有不同的key，Finish时用于生成布隆过滤器
+};
+
+#endif // !LSMKVSTORE_TABLE_BUILDER_H_
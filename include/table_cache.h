@@ -3,19 +3,38 @@
 
 #include <string>
 #include <cstddef>
-#include <bitset>
-#include <map>
-#include <fstream>
+#include <vector>
+#include <memory>
 
-#include "murmurhash3.h"
+#include "iterator.h"
+#include "dbformat.h"
+#include "block.h"
+#include "block_index.h"
+#include "table_builder.h"
+#include "bloom_filter.h"
+#include "file_cache.h"
+#include "block_cache.h"
 
 /**
  * @brief SST文件类
+ * @details Open时只把footer、布隆过滤器、学习索引和数据块索引读入内存，内存占用与数据块数量成正比，
+ *          查找时再用pread从文件中读取一个数据块。文件描述符由file_cache_统一管理，
+ *          不会每次查找都打开文件；读到的数据块放入所有SST文件共享的block_cache_。
+ *          布隆过滤器和索引由同一个SST文件的所有TableCache拷贝共享，拷贝的开销很小
 */
 class TableCache {
 public:
-    TableCache() { sst_path_ = ""; }
-    TableCache(const std::string &file_name);
+    TableCache() : time_and_size_{0, 0}, min_max_key_{0, 0}, file_size_(0), max_seq_(0),
+                   bloom_filter_(std::make_shared<BloomFilter>()),
+                   index_(std::make_shared<BlockIndex>()), file_cache_(nullptr),
+                   block_cache_(nullptr), cache_id_(0) { sst_path_ = ""; }
+
+    /**
+     * @param[in] file_name SST文件名
+     * @param[in] file_cache 已打开文件的缓存，为nullptr时每次读取都单独打开文件
+     * @param[in] block_cache 数据块缓存，为nullptr时不缓存数据块
+    */
+    TableCache(const std::string &file_name, FileCache *file_cache = nullptr, BlockCache *block_cache = nullptr);
 
     /**
      * @brief TableCache类的小于运算符重载
@@ -36,22 +55,69 @@ public:
     }
 
     /**
-     * @brief 获取SST文件中指定key对应的value
+     * @brief 获取SST文件中指定key对seq可见的最新版本
      * @param[in] key 键
-     * @return 如果key存在返回对应value，如果key不存在返回""
+     * @param[in] seq 读取的序列号，只能看到序列号不大于seq的版本
+     * @param[out] type 找到的版本的类型
+     * @param[out] val 找到的版本的value，删除标记为空
+     * @return true找到可见的版本(包括删除标记)，false文件中没有该key的可见版本
     */
-   std::string GetValue(int64_t key) const;
+   bool GetValue(int64_t key, SequenceNumber seq, ValueType *type, std::string *val) const;
+
+    /**
+     * @brief 批量获取多个key对seq可见的最新版本
+     * @details 先用布隆过滤器批量判断，再找到剩下的key所在的数据块，每个数据块只读取一次，
+     *          数据块缓存未命中的数据块通过IoBackend批量提交读请求
+     * @param[in] keys 从小到大排列的key
+     * @param[in] n key的个数
+     * @param[in] seq 读取的序列号
+     * @param[out] found 每个key是否找到可见的版本
+     * @param[out] types,vals 找到的版本的类型和value，含义同GetValue
+    */
+    void MultiGetValue(const int64_t *keys, size_t n, SequenceNumber seq, bool *found, ValueType *types,
+                       std::string *vals) const;
 
    /**
-    * @brief 打开SST文件，读入该文件中的各项元信息
+    * @brief 打开SST文件，读入footer、布隆过滤器、学习索引和数据块索引。文件不完整或格式不符时当作空文件
    */
     void Open();
 
     /**
-     * @brief 将该SST文件的键值对全部读进内存
-     * @param[out] pair 读进内存的键值对的存放位置
+     * @brief 获取SST文件的句柄，优先从file_cache_中获取
+    */
+    std::shared_ptr<RandomAccessFile> OpenFile() const;
+
+    /**
+     * @brief 从文件中读取一个数据块
+     * @param[in] file 已打开的SST文件
+     * @param[in] handle 数据块在文件中的位置
+    */
+    static Block ReadBlock(const RandomAccessFile &file, const BlockHandle &handle);
+
+    /**
+     * @brief 从文件中读取多个数据块，所有读请求通过IoBackend一次提交
+     * @return 与handles一一对应的数据块，读取失败的数据块为空
+    */
+    static std::vector<Block> ReadBlocks(const RandomAccessFile &file, const BlockHandle *handles, size_t n);
+
+    /**
+     * @brief 同ReadBlocks，但不解压，返回文件中的原始内容，之后用DecodeBlock解析
+     * @return 与handles一一对应的原始内容，读取失败的为空
     */
-    void Traverse(std::map<int64_t, std::string> &pair) const;
+    static std::vector<std::string> ReadRawBlocks(const RandomAccessFile &file, const BlockHandle *handles, size_t n);
+
+    /**
+     * @brief 解析从文件中读到的数据块：去掉末尾的压缩类型并解压，格式错误时返回空的数据块
+    */
+    static Block DecodeBlock(std::string contents);
+
+    /**
+     * @brief 获取一个数据块，优先从block_cache_中查找
+     * @param[in] file 已打开的SST文件
+     * @param[in] handle 数据块在文件中的位置
+     * @param[in] fill_cache 未命中时是否将读到的数据块放入block_cache_，遍历大量数据时不放入，避免冲掉热点数据块
+    */
+    std::shared_ptr<const Block> GetBlock(const RandomAccessFile &file, const BlockHandle &handle, bool fill_cache) const;
 
     // 获取成员属性的接口
     std::string GetFileName() const { return sst_path_; }
@@ -59,13 +125,157 @@ public:
     uint64_t GetPairNum() const { return time_and_size_[1]; }
     int64_t GetMinKey() const { return min_max_key_[0]; }
     int64_t GetMaxKey() const { return min_max_key_[1]; }
+    uint64_t GetFileSize() const { return file_size_; }
+    SequenceNumber GetMaxSequence() const { return max_seq_; }
 
 private:
+    friend class TableIterator;
+    friend class TableScanner;
+    friend class LevelIterator;
+
     std::string sst_path_;                              // SST文件的路径及文件名
     uint64_t time_and_size_[2];                    // 时间戳、元素个数
     int64_t min_max_key_[2];                        // 最小最大key
-    std::bitset<81920> bloom_filter_;    // 布隆过滤器
-    std::map<int64_t, uint32_t> key_offset_map_;    // key及其对应的偏移量
+    uint64_t file_size_;                                // 文件大小
+    SequenceNumber max_seq_;                            // 文件中最大的序列号
+    std::shared_ptr<BloomFilter> bloom_filter_;         // 布隆过滤器
+    std::shared_ptr<BlockIndex> index_;                 // 每个数据块的位置和最后一条记录的内部键
+    FileCache *file_cache_;                             // 已打开文件的缓存，不持有所有权
+    BlockCache *block_cache_;                           // 数据块缓存，不持有所有权
+    uint64_t cache_id_;                                 // 在block_cache_中的文件编号
+};
+
+/**
+ * @brief SST文件的迭代器
+ * @details 只输出每个key对seq可见的最新版本。构造时获取文件句柄并一直持有，
+ *          即使SST文件在遍历期间因compaction被删除也能继续读取。每次只解码当前所在的一个数据块。
+ *          数据块缓存中已有的数据块直接使用，是否放入新读取的数据块由fill_cache决定
+ */
+class TableIterator : public InternalIterator {
+public:
+    TableIterator(const TableCache &table, SequenceNumber seq, bool fill_cache = false);
+
+    bool Valid() const override { return block_index_ < index_->Size(); }
+    void SeekToFirst() override;
+    void SeekToLast() override;
+    void Seek(int64_t key) override;
+    void Next() override;
+    void Prev() override;
+    int64_t Key() const override { return entries_[pos_].first.key; }
+    std::string Value() const override { return entries_[pos_].second; }
+    ValueType Type() const override { return entries_[pos_].first.type; }
+
+private:
+    // 定位到第i个数据块的第一条记录，i等于数据块数量时迭代器变为无效
+    void LoadBlock(size_t i);
+    // 定位到第一个内部键大于等于target的记录
+    void RawSeek(const InternalKey &target);
+    // 移动到下一条/上一条记录，不考虑可见性。无效的迭代器视为位于最后一条记录之后
+    void RawNext();
+    void RawPrev();
+    // 是否位于第一条记录
+    bool AtFirst() const { return index_->Empty() || (block_index_ == 0 && pos_ == 0); }
+    // 从当前位置开始向后找到第一个可见的版本
+    void FindNextVisible();
+    // 在当前位置之前找到最后一个key的可见版本
+    void FindPrevVisible();
+
+    TableCache table_;
+    SequenceNumber seq_;    // 读取的序列号
+    bool fill_cache_;       // 是否将读取的数据块放入数据块缓存
+    std::shared_ptr<BlockIndex> index_;
+    size_t block_index_;    // 当前数据块的序号
+    size_t loaded_block_;   // entries_对应的数据块序号
+    std::vector<std::pair<InternalKey, std::string>> entries_;  // 当前数据块解码后的记录
+    size_t pos_;            // 当前记录在entries_中的位置
+    std::shared_ptr<RandomAccessFile> file_;
+};
+
+/**
+ * @brief level1及以上一层SST文件的迭代器
+ * @details 同一层的文件key范围不重叠，按key顺序依次遍历，同一时刻只为当前所在的文件创建TableIterator，
+ *          文件在遍历到时才通过file_cache_打开，打开的文件数不随文件总数增长。
+ *          构造时Pin该层所有文件，在此期间被compaction删除的文件仍然可以打开，析构时Unpin
+ */
+class LevelIterator : public InternalIterator {
+public:
+    /**
+     * @param[in] files 按key从小到大排列的文件，调用者需保证构造期间这些文件没有被删除
+     * @param[in] max_keys max_keys[i]为files[i]的最大key
+     * @param[in] seq 读取的序列号
+     * @param[in] fill_cache 是否将读取的数据块放入数据块缓存
+     */
+    LevelIterator(std::vector<TableCache> files, std::vector<int64_t> max_keys, SequenceNumber seq,
+                  bool fill_cache = false);
+    ~LevelIterator() override;
+
+    bool Valid() const override { return iter_ != nullptr && iter_->Valid(); }
+    void SeekToFirst() override;
+    void SeekToLast() override;
+    void Seek(int64_t key) override;
+    void Next() override;
+    void Prev() override;
+    int64_t Key() const override { return iter_->Key(); }
+    std::string Value() const override { return iter_->Value(); }
+    ValueType Type() const override { return iter_->Type(); }
+
+private:
+    // 切换到第i个文件，i超出范围时迭代器变为无效
+    void OpenTable(size_t i);
+    // 当前文件遍历完时向后/向前切换到下一个有数据的文件
+    void SkipEmptyTablesForward();
+    void SkipEmptyTablesBackward();
+
+    std::vector<TableCache> files_;
+    std::vector<int64_t> max_keys_;
+    SequenceNumber seq_;
+    bool fill_cache_;
+    size_t file_index_;     // 当前文件的序号
+    std::unique_ptr<TableIterator> iter_;   // 当前文件的迭代器，为nullptr时迭代器无效
+};
+
+/**
+ * @brief 按内部键的顺序读取SST文件中所有版本的键值对，用于compaction
+ * @details 不考虑可见性。构造时不做任何I/O，第一次Seek/SeekToFirst时才打开文件并一直持有句柄。
+ *          每次按options::kCompactionReadaheadSize的字节预算通过IoBackend提交一批数据块的读请求，
+ *          读到的数据块保持压缩状态，用到时才解压，解码时只展开当前的一个数据块，内存占用与文件大小无关。
+ *          compaction读取的数据块很快就会被删除，不经过数据块缓存
+ */
+class TableScanner {
+public:
+    explicit TableScanner(const TableCache &table);
+    TableScanner(const TableScanner &) = delete;
+    TableScanner &operator=(const TableScanner &) = delete;
+
+    bool Valid() const { return pos_ < entries_.size(); }
+    const InternalKey &Key() const { return entries_[pos_].first; }
+    const std::string &Value() const { return entries_[pos_].second; }
+    void Next();
+
+    /**
+     * @brief 定位到第一条记录
+     */
+    void SeekToFirst() { SeekToBlock(0); }
+
+    /**
+     * @brief 定位到第一个key大于等于key的记录，只读取从该记录所在数据块开始的数据块
+     */
+    void Seek(int64_t key);
+
+private:
+    // 丢弃已预读的数据块，定位到第i个数据块的第一条记录
+    void SeekToBlock(size_t i);
+    // 解码下一个非空的数据块，当前一批数据块用完时读取下一批。没有更多数据块时entries_为空
+    void LoadNextBlock();
+
+    TableCache table_;
+    std::shared_ptr<BlockIndex> index_;
+    std::shared_ptr<RandomAccessFile> file_;    // 第一次定位时才打开
+    size_t next_read_;      // 下一批要读取的第一个数据块的序号
+    std::vector<std::string> batch_;    // 已读取但还没有解压和解码的数据块
+    size_t batch_pos_;      // 下一个要解码的数据块在batch_中的位置
+    std::vector<std::pair<InternalKey, std::string>> entries_;  // 当前数据块解码后的记录
+    size_t pos_;            // 当前记录在entries_中的位置
 };
 
 #endif // !LSMKVSTORE_TABLE_CACHE_H_
\ No newline at end of file
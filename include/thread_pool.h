@@ -12,19 +12,31 @@
 #include <memory>
 #include <functional>
 #include <utility>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 
 // 多个线程共享一个任务队列，一个线程负责产生任务，并将任务放到任务队列中，
 // 还要在这个任务执行后获取它的返回值，多个子线程从任务队列中取出任务并执行
 
 class ThreadPool {
 public:
-    explicit ThreadPool(std::size_t);
+    /**
+     * @param[in] thread_num 线程数量
+     * @param[in] nice 工作线程的nice值，大于0时降低线程的调度优先级，用于后台compaction
+     */
+    explicit ThreadPool(std::size_t thread_num, int nice = 0);
     ThreadPool(const ThreadPool &) = delete;
     ThreadPool(ThreadPool &&) = delete;
     ThreadPool &operator=(const ThreadPool &) = delete;
     ThreadPool &operator=(ThreadPool &&) = delete;
     ~ThreadPool();
 
+    /**
+     * @brief 停止接受新任务，等队列中已有的任务全部执行完后回收工作线程，可以重复调用
+     */
+    void Close();
+
     template <class F, class... Args> // 参照std::thread的初始化构造函数https://www.runoob.com/w3cnote/cpp-std-thread.html
     auto Enqueue(F &&f, Args &&...args) -> std::future<typename std::result_of<F(Args...)>::type>;
 
@@ -39,11 +51,13 @@ private:
 /**
  * @brief 线程池的构造函数
  * @param[in] thread_num 线程数量
+ * @param[in] nice 工作线程的nice值
 */
-ThreadPool::ThreadPool(std::size_t thread_num) : stop_(false) {
+inline ThreadPool::ThreadPool(std::size_t thread_num, int nice) : stop_(false) {
     for (std::size_t i = 0; i < thread_num; ++i) {
-        workers_.emplace_back([this]{
-            while (!stop_) {
+        workers_.emplace_back([this, nice]{
+            if (nice != 0) setpriority(PRIO_PROCESS, syscall(SYS_gettid), nice);   // Linux下nice值对单个线程生效
+            while (true) {
                 std::function<void()> task;  // 用于存储待执行的任务
                 {
                     std::unique_lock<std::mutex> lock(this->mutex_); // 创建一个独占锁对象lock，并锁定ThreadPool对象的mutex_成员
@@ -58,11 +72,18 @@ ThreadPool::ThreadPool(std::size_t thread_num) : stop_(false) {
     }
 }
 
-ThreadPool::~ThreadPool() {
-    this->stop_.store(true);            // 用非原子参数替换原子对象的值
-    this->cond_.notify_all();          // 唤醒所有等待的线程
+inline ThreadPool::~ThreadPool() {
+    Close();
+}
+
+inline void ThreadPool::Close() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        this->stop_.store(true);        // 在锁内修改，避免工作线程检查条件后错过通知
+    }
+    this->cond_.notify_all();          // 唤醒所有等待的线程，队列为空后退出
     for (std::thread &worker : workers_) {
-        worker.join();
+        if (worker.joinable()) worker.join();
     }
 }
 
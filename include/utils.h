@@ -9,6 +9,7 @@
 #include <string.h>
 #include <sstream>
 #include <unistd.h>
+#include <fcntl.h>
 
 namespace utils {
 
@@ -59,7 +60,7 @@ inline int ScanDir(const std::string path, std::vector<std::string> &ret) {
  * @param[in] path 要判断的目录
  * @return true存在，false不存在
  */
-bool DirExists(std::string path) {
+inline bool DirExists(std::string path) {
     struct stat st;
     int ret = stat(path.c_str(), &st);
     return (ret == 0) && (S_ISDIR(st.st_mode));
@@ -85,6 +86,10 @@ inline bool MkDir(const char *path) {
     std::string dir_name;
     while (std::getline(ss, dir_name, '/')) {
         cur_path += dir_name;
+        if (dir_name.empty()) {     // 绝对路径开头的'/'或连续的'/'
+            cur_path += "/";
+            continue;
+        }
         if (!DirExists(cur_path) && _MkDir(cur_path.c_str()) != 0) {
             return false;
         }
@@ -93,6 +98,19 @@ inline bool MkDir(const char *path) {
     return true;
 }
 
+/**
+ * @brief 将目录的修改(新建、删除文件)刷到磁盘，新文件刷盘后还要同步所在目录才能在崩溃后找到
+ * @param[in] path 目录路径
+ * @return 成功返回true
+ */
+inline bool SyncDir(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return false;
+    bool ok = (::fsync(fd) == 0);
+    ::close(fd);
+    return ok;
+}
+
 /**
  * @brief 删除一个文件
  * @param[in] path 要删除的文件路径
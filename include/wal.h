@@ -0,0 +1,113 @@
+#ifndef LSMKVSTORE_WAL_H_
+#define LSMKVSTORE_WAL_H_
+
+#include <string>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "options.h"
+
+// WAL文件由若干条物理记录组成，每条物理记录对应一次组提交：
+// | checksum(4B) | length(4B) | payload(length B) |
+// KVStore写入的payload以组内第一个操作的序列号(8B)开头，之后由若干条逻辑记录拼接而成，
+// 第i条逻辑记录的序列号为该序列号 + i。每条逻辑记录为：
+// | type(1B) | key(8B) | val_len(4B) | val(val_len B) |
+
+namespace wal {
+
+// 逻辑记录的类型
+enum RecordType : uint8_t {
+    kTypeValue = 1,     // 插入/更新
+    kTypeDeletion = 2   // 删除
+};
+
+// 物理记录头部大小：checksum + length
+const int kHeaderSize = 8;
+
+/**
+ * @brief 将一条逻辑记录编码后追加到dst末尾
+ * @param[out] dst 编码结果的存放位置
+ * @param[in] type 记录类型
+ * @param[in] key 键
+ * @param[in] val 值，删除记录为空
+ */
+void EncodeRecord(std::string *dst, RecordType type, int64_t key, const std::string &val);
+
+/**
+ * @brief 从payload的pos处解码一条逻辑记录，并将pos移动到下一条记录
+ * @return true解码成功，false数据不完整
+ */
+bool DecodeRecord(const std::string &payload, size_t *pos, RecordType *type, int64_t *key, std::string *val);
+
+/**
+ * @brief 只解码pos处逻辑记录的key，不拷贝value，并将pos移动到下一条记录
+ * @return true解码成功，false数据不完整
+ */
+bool DecodeRecordKey(const std::string &payload, size_t *pos, int64_t *key);
+
+}   // namespace wal
+
+/**
+ * @brief 追加写的WAL文件
+ * @details 每次AddRecord对应一次write，是否fdatasync由刷盘策略决定；
+ *          kSyncInterval模式下由后台线程定期fdatasync
+ */
+class WalWriter {
+public:
+    WalWriter(const std::string &file_name, options::WalSyncMode mode);
+    WalWriter(const WalWriter &) = delete;
+    WalWriter &operator=(const WalWriter &) = delete;
+    ~WalWriter();
+
+    /**
+     * @brief 将payload封装成一条物理记录写入文件
+     * @details 只会被组提交的leader调用，一次调用只产生一次write和至多一次fdatasync
+     * @return true成功，false写入失败
+     */
+    bool AddRecord(const std::string &payload);
+
+    /**
+     * @brief 将已写入的数据刷到磁盘
+     */
+    bool Sync();
+
+    std::string GetFileName() const { return file_name_; }
+
+private:
+    // kSyncInterval模式下后台线程的执行函数
+    void BackgroundSync();
+
+    std::string file_name_;
+    int fd_;
+    options::WalSyncMode mode_;
+
+    bool dirty_;        // 是否有未刷盘的数据
+    bool stop_;
+    std::thread sync_thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+};
+
+/**
+ * @brief 顺序读取WAL文件中的物理记录，用于重启时回放
+ */
+class WalReader {
+public:
+    explicit WalReader(const std::string &file_name);
+    WalReader(const WalReader &) = delete;
+    WalReader &operator=(const WalReader &) = delete;
+    ~WalReader();
+
+    /**
+     * @brief 读取下一条物理记录的payload
+     * @details 遇到文件末尾、不完整的记录(写到一半时崩溃)或校验失败时返回false
+     */
+    bool ReadRecord(std::string *payload);
+
+private:
+    int fd_;
+};
+
+#endif // !LSMKVSTORE_WAL_H_
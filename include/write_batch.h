@@ -0,0 +1,50 @@
+#ifndef LSMKVSTORE_WRITE_BATCH_H_
+#define LSMKVSTORE_WRITE_BATCH_H_
+
+#include <string>
+#include <cstdint>
+
+#include "wal.h"
+
+/**
+ * @brief 一批原子写入的Put/Del操作
+ * @details 内部按WAL逻辑记录的格式编码，提交时加上序列号即可作为WAL记录的payload写入，
+ *          KVStore::Write在一次加锁中将整批操作写入MemTable
+ */
+class WriteBatch {
+public:
+    WriteBatch() : count_(0) {}
+
+    /**
+     * @brief 添加一个插入/更新操作
+     * @param[in] key 键
+     * @param[in] val 值
+     */
+    void Put(int64_t key, const std::string &val);
+
+    /**
+     * @brief 添加一个删除操作
+     * @param[in] key 要删除的键
+     */
+    void Del(int64_t key);
+
+    /**
+     * @brief 清空所有操作
+     */
+    void Clear();
+
+    // 获取操作个数
+    size_t Count() const { return count_; }
+
+    // 获取编码后的字节数，也是整批写入MemTable后其大小最多增加的字节数
+    size_t ApproximateSize() const { return rep_.size(); }
+
+    // 获取编码后的所有操作
+    const std::string &Rep() const { return rep_; }
+
+private:
+    std::string rep_;   // 依次存放的WAL逻辑记录
+    size_t count_;      // 操作个数
+};
+
+#endif // !LSMKVSTORE_WRITE_BATCH_H_
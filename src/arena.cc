@@ -0,0 +1,46 @@
+#include "arena.h"
+
+Arena::Arena()
+    : current_(nullptr), memory_usage_(0) {}
+
+Arena::~Arena() {
+    for (Block *block : blocks_) {
+        delete[] block->data;
+        delete block;
+    }
+}
+
+char *Arena::AllocateAligned(size_t bytes) {
+    // 每次分配的大小都是kAlign的倍数，新块本身是对齐的，因此块内的每个分配都从对齐的位置开始
+    bytes = (bytes + kAlign - 1) & ~(kAlign - 1);
+    if (bytes > kBlockSize / 4) {
+        // 大对象单独申请一块，避免浪费当前块的剩余空间
+        std::lock_guard<std::mutex> lock(mutex_);
+        return AllocateNewBlock(bytes)->data;
+    }
+
+    while (true) {
+        Block *block = current_.load(std::memory_order_acquire);
+        if (block != nullptr) {
+            size_t offset = block->used.fetch_add(bytes, std::memory_order_relaxed);
+            if (offset + bytes <= block->size) {
+                return block->data + offset;
+            }
+        }
+        // 当前块空间不足，由第一个拿到锁的线程换上新块，其他线程直接重试
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_.load(std::memory_order_relaxed) == block) {
+            current_.store(AllocateNewBlock(kBlockSize), std::memory_order_release);
+        }
+    }
+}
+
+Arena::Block *Arena::AllocateNewBlock(size_t block_bytes) {
+    Block *block = new Block;
+    block->data = new char[block_bytes];
+    block->size = block_bytes;
+    block->used.store(0, std::memory_order_relaxed);
+    blocks_.emplace_back(block);
+    memory_usage_.fetch_add(block_bytes + sizeof(Block) + sizeof(Block *), std::memory_order_relaxed);
+    return block;
+}
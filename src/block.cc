@@ -0,0 +1,167 @@
+#include "block.h"
+
+#include <string.h>
+
+#include "options.h"
+
+void PutVarint32(std::string *dst, uint32_t v) {
+    PutVarint64(dst, v);
+}
+
+void PutVarint64(std::string *dst, uint64_t v) {
+    while (v >= 128) {
+        dst->push_back(static_cast<char>(v | 128));
+        v >>= 7;
+    }
+    dst->push_back(static_cast<char>(v));
+}
+
+const char *GetVarint32(const char *p, const char *limit, uint32_t *v) {
+    uint64_t result;
+    p = GetVarint64(p, limit, &result);
+    if (p == nullptr || result > UINT32_MAX) return nullptr;
+    *v = static_cast<uint32_t>(result);
+    return p;
+}
+
+const char *GetVarint64(const char *p, const char *limit, uint64_t *v) {
+    uint64_t result = 0;
+    for (int shift = 0; shift <= 63 && p < limit; shift += 7) {
+        uint64_t byte = static_cast<unsigned char>(*p++);
+        result |= (byte & 127) << shift;
+        if ((byte & 128) == 0) {
+            *v = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+BlockBuilder::BlockBuilder() : counter_(0), last_key_(0) {
+    restarts_.push_back(0);     // 第一条记录总是重启点
+}
+
+void BlockBuilder::Add(const InternalKey &ikey, const char *val, size_t len) {
+    int64_t base = last_key_;
+    if (counter_ >= options::kBlockRestartInterval) {
+        restarts_.push_back(buffer_.size());
+        counter_ = 0;
+    }
+    if (counter_ == 0) base = 0;
+
+    // 按无符号数相减，负数key和跨越0的差值也能正确还原
+    PutVarint64(&buffer_, static_cast<uint64_t>(ikey.key) - static_cast<uint64_t>(base));
+    PutVarint64(&buffer_, PackSequenceAndType(ikey.seq, ikey.type));
+    PutVarint32(&buffer_, len);
+    buffer_.append(val, len);
+
+    last_key_ = ikey.key;
+    ++counter_;
+}
+
+const std::string &BlockBuilder::Finish() {
+    for (uint32_t restart : restarts_) {
+        buffer_.append((const char *)&restart, sizeof(uint32_t));
+    }
+    uint32_t num_restarts = restarts_.size();
+    buffer_.append((const char *)&num_restarts, sizeof(uint32_t));
+    return buffer_;
+}
+
+void BlockBuilder::Reset() {
+    buffer_.clear();
+    restarts_.assign(1, 0);
+    counter_ = 0;
+    last_key_ = 0;
+}
+
+Block::Block(std::string contents) : data_(std::move(contents)), restart_offset_(0), num_restarts_(0) {
+    if (data_.size() < sizeof(uint32_t)) return;
+    memcpy(&num_restarts_, data_.data() + data_.size() - sizeof(uint32_t), sizeof(uint32_t));
+    uint64_t restarts_size = (static_cast<uint64_t>(num_restarts_) + 1) * sizeof(uint32_t);
+    if (restarts_size > data_.size()) {
+        num_restarts_ = 0;  // 数据损坏，当作空块
+        return;
+    }
+    restart_offset_ = data_.size() - restarts_size;
+}
+
+uint32_t Block::RestartPoint(uint32_t i) const {
+    uint32_t offset;
+    memcpy(&offset, data_.data() + restart_offset_ + i * sizeof(uint32_t), sizeof(uint32_t));
+    return offset;
+}
+
+const char *Block::DecodeEntry(const char *p, int64_t base, InternalKey *ikey, const char **val, uint32_t *len) const {
+    const char *limit = data_.data() + restart_offset_;
+    uint64_t delta, tag;
+    if ((p = GetVarint64(p, limit, &delta)) == nullptr) return nullptr;
+    if ((p = GetVarint64(p, limit, &tag)) == nullptr) return nullptr;
+    if ((p = GetVarint32(p, limit, len)) == nullptr) return nullptr;
+    if (*len > static_cast<uint64_t>(limit - p)) return nullptr;
+
+    ikey->key = static_cast<int64_t>(static_cast<uint64_t>(base) + delta);
+    ikey->seq = tag >> 8;
+    ikey->type = static_cast<ValueType>(tag & 0xff);
+    *val = p;
+    return p + *len;
+}
+
+bool Block::Seek(const InternalKey &target, InternalKey *ikey, std::string *val) const {
+    if (num_restarts_ == 0) return false;
+
+    // 二分查找最后一个内部键小于target的重启点，之后的记录都从该重启点开始解码
+    const char *val_ptr;
+    uint32_t len;
+    uint32_t left = 0, right = num_restarts_ - 1;
+    while (left < right) {
+        uint32_t mid = (left + right + 1) / 2;
+        InternalKey mid_key;
+        if (DecodeEntry(data_.data() + RestartPoint(mid), 0, &mid_key, &val_ptr, &len) == nullptr) return false;
+        if (mid_key < target) {
+            left = mid;
+        } else {
+            right = mid - 1;
+        }
+    }
+
+    const char *p = data_.data() + RestartPoint(left);
+    const char *limit = data_.data() + restart_offset_;
+    uint32_t next_restart = left + 1;
+    int64_t base = 0;
+    while (p < limit) {
+        // 到达下一个重启点时key重新以0为基准
+        if (next_restart < num_restarts_ && p == data_.data() + RestartPoint(next_restart)) {
+            base = 0;
+            ++next_restart;
+        }
+        p = DecodeEntry(p, base, ikey, &val_ptr, &len);
+        if (p == nullptr) return false;
+        if (!(*ikey < target)) {
+            val->assign(val_ptr, len);
+            return true;
+        }
+        base = ikey->key;
+    }
+    return false;
+}
+
+void Block::DecodeAll(std::vector<std::pair<InternalKey, std::string>> *entries) const {
+    const char *p = data_.data();
+    const char *limit = data_.data() + restart_offset_;
+    uint32_t next_restart = 0;
+    int64_t base = 0;
+    InternalKey ikey;
+    const char *val_ptr;
+    uint32_t len;
+    while (p < limit) {
+        if (next_restart < num_restarts_ && p == data_.data() + RestartPoint(next_restart)) {
+            base = 0;
+            ++next_restart;
+        }
+        p = DecodeEntry(p, base, &ikey, &val_ptr, &len);
+        if (p == nullptr) return;
+        entries->emplace_back(ikey, std::string(val_ptr, len));
+        base = ikey.key;
+    }
+}
@@ -0,0 +1,62 @@
+#include "block_cache.h"
+
+BlockCache::BlockCache(size_t capacity, int shard_bits)
+    : shard_capacity_(capacity >> shard_bits), shard_bits_(shard_bits), shards_(size_t(1) << shard_bits),
+      next_id_(1), hits_(0), misses_(0) {}
+
+BlockCache::Shard &BlockCache::GetShard(const CacheKey &key) {
+    // 用哈希值的高位选择分片，分片内的unordered_map使用低位
+    uint64_t hash = CacheKeyHash()(key) * 0x9E3779B97F4A7C15ULL;
+    return shards_[shard_bits_ == 0 ? 0 : hash >> (64 - shard_bits_)];
+}
+
+std::shared_ptr<const Block> BlockCache::Lookup(uint64_t id, uint64_t offset) {
+    CacheKey key{id, offset};
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.map.find(key);
+    if (iter == shard.map.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+    return iter->second->block;
+}
+
+void BlockCache::Insert(uint64_t id, uint64_t offset, std::shared_ptr<const Block> block) {
+    CacheKey key{id, offset};
+    size_t charge = block->Size() + sizeof(Block);
+    Shard &shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // 两个线程同时读取同一个数据块时，后插入的替换先插入的
+    auto iter = shard.map.find(key);
+    if (iter != shard.map.end()) {
+        shard.usage -= iter->second->charge;
+        shard.lru.erase(iter->second);
+        shard.map.erase(iter);
+    }
+
+    shard.lru.push_front(Entry{key, std::move(block), charge});
+    shard.map[key] = shard.lru.begin();
+    shard.usage += charge;
+
+    // 淘汰最久未使用的数据块，刚插入的数据块即使超过分片容量也保留
+    while (shard.usage > shard_capacity_ && shard.lru.size() > 1) {
+        Entry &victim = shard.lru.back();
+        shard.usage -= victim.charge;
+        shard.map.erase(victim.key);
+        shard.lru.pop_back();
+    }
+}
+
+size_t BlockCache::GetUsage() const {
+    size_t usage = 0;
+    for (const Shard &shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        usage += shard.usage;
+    }
+    return usage;
+}
@@ -0,0 +1,71 @@
+#include "block_index.h"
+
+
+// 每个cache line中的key数。在第k个节点预取第kKeysPerCacheLine * k个节点，
+// 即3层之后的8个子孙所在的cache line
+static const size_t kKeysPerCacheLine = 64 / sizeof(int64_t);
+
+BlockIndex::BlockIndex(std::vector<BlockHandle> handles, const std::string &learned)
+    : handles_(std::move(handles)), learned_(learned) {
+    if (!learned_.Empty()) return;
+    keys_.resize(handles_.size() + 1);
+    ranks_.resize(handles_.size() + 1);
+    Build(0, 1);
+}
+
+size_t BlockIndex::Build(size_t i, size_t k) {
+    if (k > handles_.size()) return i;
+    i = Build(i, 2 * k);
+    keys_[k] = handles_[i].last_key.key;
+    ranks_[k] = static_cast<uint32_t>(i);
+    return Build(i + 1, 2 * k + 1);
+}
+
+size_t BlockIndex::Search(int64_t key, size_t lo, size_t hi) const {
+    // 无分支的二分：每一步把范围缩小一半，比较结果只用于选择下一个起点
+    if (lo >= hi) return lo;
+    const BlockHandle *base = handles_.data() + lo;
+    size_t len = hi - lo;
+    while (len > 1) {
+        size_t half = len / 2;
+        base = (base[half - 1].last_key.key < key) ? base + half : base;
+        len -= half;
+    }
+    return (base - handles_.data()) + (base->last_key.key < key);
+}
+
+size_t BlockIndex::LowerBound(int64_t key) const {
+    const size_t n = handles_.size();
+    if (!learned_.Empty()) {
+        size_t lo, hi;
+        learned_.Predict(key, n, &lo, &hi);
+        size_t i = Search(key, lo, hi);
+        if ((i == 0 || handles_[i - 1].last_key.key < key) && (i == n || handles_[i].last_key.key >= key)) {
+            return i;
+        }
+        return Search(key, 0, n);   // 预测错误，在所有数据块上二分
+    }
+
+    const int64_t *keys = keys_.data();
+    size_t k = 1;
+    while (k <= n) {
+        __builtin_prefetch(keys + ((kKeysPerCacheLine * k) & -(kKeysPerCacheLine * k <= n)));
+        k = 2 * k + (keys[k] < key);
+    }
+    // k的二进制表示记录了查找路径，1表示向右。去掉末尾连续的1和最后一次向左的0，
+    // 得到最后一个向左走的节点，即第一个不小于key的节点。全部向右时k变为0
+    k >>= __builtin_ffsll(~static_cast<long long>(k));
+    return (k == 0) ? n : ranks_[k];
+}
+
+size_t BlockIndex::LowerBound(const InternalKey &target) const {
+    // 同一个key的版本可能跨越多个数据块，跳过最后一条记录比target新的数据块
+    size_t i = LowerBound(target.key);
+    while (i < handles_.size() && handles_[i].last_key < target) ++i;
+    return i;
+}
+
+size_t BlockIndex::MemoryUsage() const {
+    return handles_.capacity() * sizeof(BlockHandle) + keys_.capacity() * sizeof(int64_t) +
+           ranks_.capacity() * sizeof(uint32_t) + learned_.MemoryUsage();
+}
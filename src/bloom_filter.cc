@@ -0,0 +1,186 @@
+#include "bloom_filter.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LSMKVSTORE_HAVE_X86 1
+#endif
+
+#include "murmurhash3.h"
+
+// 分块格式的块大小，与cache line相同
+static const int kCacheLineSize = 64;
+
+// 分块格式最后一个字节的标记，标准格式的探测次数不会超过30
+static const unsigned char kBlockedMarker = 0x80;
+
+// 分块格式中每个64位字使用的乘数，来自Parquet的split block bloom filter
+static const uint32_t kSalt[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+
+// 计算key的两个64位哈希值
+static void BloomHash(int64_t key, uint64_t *h1, uint64_t *h2) {
+    uint64_t hash[2];
+    MurmurHash3_x64_128(&key, sizeof(key), 1, hash);
+    *h1 = hash[0];
+    *h2 = hash[1] | 1;  // 保证步长不为0
+}
+
+// 第j个64位字中要设置的位
+static inline uint64_t BlockedMask(uint32_t h, int j) {
+    return 1ULL << ((h * kSalt[j]) >> 26);
+}
+
+static void BlockedSet(char *block, uint32_t h) {
+    for (int j = 0; j < 8; ++j) {
+        uint64_t word;
+        memcpy(&word, block + j * 8, sizeof(uint64_t));
+        word |= BlockedMask(h, j);
+        memcpy(block + j * 8, &word, sizeof(uint64_t));
+    }
+}
+
+static bool BlockedProbeScalar(const char *block, uint32_t h) {
+    for (int j = 0; j < 8; ++j) {
+        uint64_t word;
+        memcpy(&word, block + j * 8, sizeof(uint64_t));
+        if ((word & BlockedMask(h, j)) == 0) return false;
+    }
+    return true;
+}
+
+#ifdef LSMKVSTORE_HAVE_X86
+// 8个32位乘法和移位一次完成，再扩展成两组4个64位的掩码，与块的前后32字节比较
+__attribute__((target("avx2")))
+static bool BlockedProbeAvx2(const char *block, uint32_t h) {
+    __m256i salt = _mm256_loadu_si256((const __m256i *)kSalt);
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(h), salt), 26);
+    __m256i one = _mm256_set1_epi64x(1);
+    __m256i mask_lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shifts)));
+    __m256i mask_hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shifts, 1)));
+    __m256i word_lo = _mm256_loadu_si256((const __m256i *)block);
+    __m256i word_hi = _mm256_loadu_si256((const __m256i *)(block + 32));
+    // testc(a, b)在b的每一位在a中都为1时返回1
+    return _mm256_testc_si256(word_lo, mask_lo) & _mm256_testc_si256(word_hi, mask_hi);
+}
+#endif
+
+bool BloomFilter::HasAvx2() {
+#ifdef LSMKVSTORE_HAVE_X86
+    static const bool has_avx2 = __builtin_cpu_supports("avx2");
+    return has_avx2;
+#else
+    return false;
+#endif
+}
+
+// 在运行时选择分块格式的探测实现
+static bool BlockedProbe(const char *block, uint32_t h) {
+#ifdef LSMKVSTORE_HAVE_X86
+    static const bool use_avx2 = BloomFilter::HasAvx2();
+    if (use_avx2) return BlockedProbeAvx2(block, h);
+#endif
+    return BlockedProbeScalar(block, h);
+}
+
+BloomFilter::BloomFilter(std::string contents)
+    : data_(std::move(contents)), blocked_(false), num_probes_(0), num_blocks_(0) {
+    if (data_.size() < 2) return;
+    if (static_cast<unsigned char>(data_.back()) == kBlockedMarker) {
+        if ((data_.size() - 2) % kCacheLineSize != 0) return;
+        blocked_ = true;
+        num_probes_ = static_cast<unsigned char>(data_[data_.size() - 2]);
+        num_blocks_ = (data_.size() - 2) / kCacheLineSize;
+    } else {
+        num_probes_ = static_cast<unsigned char>(data_.back());
+    }
+}
+
+std::string BloomFilter::Build(const std::vector<int64_t> &keys, int bits_per_key, bool blocked) {
+    if (blocked) {
+        // 块数向上取整，至少一块
+        uint64_t num_blocks = (keys.size() * bits_per_key + kCacheLineSize * 8 - 1) / (kCacheLineSize * 8);
+        if (num_blocks == 0) num_blocks = 1;
+        std::string filter(num_blocks * kCacheLineSize, '\0');
+        filter.push_back(8);
+        filter.push_back(static_cast<char>(kBlockedMarker));
+        for (int64_t key : keys) {
+            uint64_t h1, h2;
+            BloomHash(key, &h1, &h2);
+            uint64_t index = ((h1 >> 32) * num_blocks) >> 32;
+            BlockedSet(&filter[index * kCacheLineSize], static_cast<uint32_t>(h2));
+        }
+        return filter;
+    }
+
+    // 位数太少时误判率很高，至少使用64位
+    uint64_t bits = keys.size() * bits_per_key;
+    if (bits < 64) bits = 64;
+    uint64_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+
+    // 误判率最低时每个key设置的位数为bits_per_key * ln2
+    int num_probes = static_cast<int>(bits_per_key * 0.69);
+    if (num_probes < 1) num_probes = 1;
+    if (num_probes > 30) num_probes = 30;
+
+    std::string filter(bytes, '\0');
+    filter.push_back(static_cast<char>(num_probes));
+    for (int64_t key : keys) {
+        uint64_t h1, h2;
+        BloomHash(key, &h1, &h2);
+        for (int i = 0; i < num_probes; ++i) {
+            uint64_t pos = (h1 + i * h2) % bits;
+            filter[pos / 8] |= (1 << (pos % 8));
+        }
+    }
+    return filter;
+}
+
+const char *BloomFilter::BlockFor(uint64_t h1) const {
+    uint64_t index = ((h1 >> 32) * num_blocks_) >> 32;
+    return data_.data() + index * kCacheLineSize;
+}
+
+bool BloomFilter::KeyMayMatch(int64_t key) const {
+    if (num_probes_ < 1 || (!blocked_ && num_probes_ > 30) || (blocked_ && num_blocks_ == 0)) return true;
+
+    uint64_t h1, h2;
+    BloomHash(key, &h1, &h2);
+    if (blocked_) {
+        return BlockedProbe(BlockFor(h1), static_cast<uint32_t>(h2));
+    }
+
+    uint64_t bits = (data_.size() - 1) * 8;
+    for (int i = 0; i < num_probes_; ++i) {
+        uint64_t pos = (h1 + i * h2) % bits;
+        if ((data_[pos / 8] & (1 << (pos % 8))) == 0) return false;
+    }
+    return true;
+}
+
+void BloomFilter::KeysMayMatch(const int64_t *keys, size_t n, bool *results) const {
+    if (!blocked_ || num_blocks_ == 0 || num_probes_ < 1) {
+        for (size_t i = 0; i < n; ++i) results[i] = KeyMayMatch(keys[i]);
+        return;
+    }
+
+    // 每次处理8个key：先计算哈希值并预取所有块，再依次探测
+    const size_t kBatch = 8;
+    const char *blocks[kBatch];
+    uint32_t hashes[kBatch];
+    for (size_t start = 0; start < n; start += kBatch) {
+        size_t count = (n - start < kBatch) ? n - start : kBatch;
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t h1, h2;
+            BloomHash(keys[start + i], &h1, &h2);
+            blocks[i] = BlockFor(h1);
+            hashes[i] = static_cast<uint32_t>(h2);
+            __builtin_prefetch(blocks[i]);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            results[start + i] = BlockedProbe(blocks[i], hashes[i]);
+        }
+    }
+}
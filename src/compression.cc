@@ -0,0 +1,214 @@
+#include "compression.h"
+
+#include <string.h>
+#include <algorithm>
+
+#ifdef LSMKVSTORE_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef LSMKVSTORE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "block.h"
+
+// 内置压缩格式：| raw_len(varint32) | op 0 | op 1 | ... |
+// 每个op为：| literal_len(varint32) | literal | match_len - kMinMatch(varint32) | offset(varint32) |，
+// 先原样复制literal，再从已输出内容的offset字节之前复制match_len字节(可以与输出重叠)。
+// 输出达到raw_len时结束，因此最后一个op可能只有literal部分，或者在match之后直接结束
+
+// 最短的匹配长度
+static const uint32_t kMinMatch = 4;
+
+// 哈希表大小的对数，每项记录最近一次出现该4字节序列的位置。数据块只有几KB，1024项足够
+static const int kHashBits = 10;
+
+// 连续多少次没有找到匹配后增大查找步长，快速跳过不可压缩的数据
+static const int kSkipTrigger = 5;
+
+static inline uint32_t Load32(const char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+static inline uint64_t Load64(const char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(uint64_t));
+    return v;
+}
+
+// 从a和b开始的相同字节数，b之后最多还有limit个字节。每次比较8个字节
+static inline size_t MatchLength(const char *a, const char *b, size_t limit) {
+    size_t len = 0;
+    while (len + 8 <= limit) {
+        uint64_t diff = Load64(a + len) ^ Load64(b + len);
+        if (diff != 0) return len + (__builtin_ctzll(diff) >> 3);
+        len += 8;
+    }
+    while (len < limit && a[len] == b[len]) ++len;
+    return len;
+}
+
+static inline uint32_t HashBytes(uint32_t v) {
+    return (v * 0x9E3779B1U) >> (32 - kHashBits);
+}
+
+static void FastCompress(const char *data, size_t n, std::string *output) {
+    output->clear();
+    output->reserve(n / 2 + 16);
+    PutVarint32(output, static_cast<uint32_t>(n));
+
+    // 记录位置+1，0表示没有出现过
+    uint32_t table[1 << kHashBits] = {0};
+    size_t anchor = 0;     // 还没有输出的literal的起始位置
+    size_t pos = 0;
+    uint32_t misses = 0;
+    while (pos + kMinMatch <= n) {
+        uint32_t cur = Load32(data + pos);
+        uint32_t &slot = table[HashBytes(cur)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(pos + 1);
+        if (candidate == 0 || Load32(data + candidate - 1) != cur) {
+            pos += 1 + (misses++ >> kSkipTrigger);
+            continue;
+        }
+        --candidate;
+        misses = 0;
+
+        size_t len = kMinMatch + MatchLength(data + candidate + kMinMatch, data + pos + kMinMatch,
+                                             n - pos - kMinMatch);
+
+        PutVarint32(output, static_cast<uint32_t>(pos - anchor));
+        output->append(data + anchor, pos - anchor);
+        PutVarint32(output, static_cast<uint32_t>(len - kMinMatch));
+        PutVarint32(output, static_cast<uint32_t>(pos - candidate));
+        pos += len;
+        anchor = pos;
+    }
+    if (anchor < n) {
+        PutVarint32(output, static_cast<uint32_t>(n - anchor));
+        output->append(data + anchor, n - anchor);
+    }
+}
+
+static bool FastUncompress(const char *data, size_t n, std::string *output) {
+    const char *p = data, *limit = data + n;
+    uint32_t raw_len;
+    if ((p = GetVarint32(p, limit, &raw_len)) == nullptr) return false;
+    output->resize(raw_len);
+    char *base = &(*output)[0];
+    size_t size = 0;    // 已输出的字节数
+
+    while (size < raw_len) {
+        uint32_t literal_len, match_len, offset;
+        if ((p = GetVarint32(p, limit, &literal_len)) == nullptr) return false;
+        if (literal_len > static_cast<size_t>(limit - p) || literal_len > raw_len - size) return false;
+        memcpy(base + size, p, literal_len);
+        size += literal_len;
+        p += literal_len;
+        if (size == raw_len) break;
+
+        if ((p = GetVarint32(p, limit, &match_len)) == nullptr) return false;
+        if ((p = GetVarint32(p, limit, &offset)) == nullptr) return false;
+        match_len += kMinMatch;
+        if (offset == 0 || offset > size || match_len > raw_len - size) return false;
+        // 匹配可能与要输出的部分重叠，此时内容以offset为周期重复。从src开始的内容都是周期重复的，
+        // 每次把[src, size)复制到末尾，不会重叠，复制的长度每次翻倍
+        size_t src = size - offset;
+        while (match_len > 0) {
+            size_t chunk = std::min<size_t>(match_len, size - src);
+            memcpy(base + size, base + src, chunk);
+            size += chunk;
+            match_len -= chunk;
+        }
+    }
+    return p == limit;
+}
+
+bool CompressionSupported(CompressionType type) {
+    switch (type) {
+        case kNoCompression:
+        case kFastCompression:
+            return true;
+#ifdef LSMKVSTORE_HAVE_LZ4
+        case kLZ4Compression:
+            return true;
+#endif
+#ifdef LSMKVSTORE_HAVE_ZSTD
+        case kZstdCompression:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+bool Compress(CompressionType type, const char *data, size_t n, std::string *output) {
+    switch (type) {
+        case kNoCompression:
+            output->assign(data, n);
+            return true;
+        case kFastCompression:
+            FastCompress(data, n, output);
+            break;
+#ifdef LSMKVSTORE_HAVE_LZ4
+        case kLZ4Compression: {
+            // lz4的块格式不记录原始长度，在前面加上
+            output->clear();
+            PutVarint32(output, static_cast<uint32_t>(n));
+            size_t header = output->size();
+            output->resize(header + LZ4_compressBound(static_cast<int>(n)));
+            int size = LZ4_compress_default(data, &(*output)[header], static_cast<int>(n),
+                                            static_cast<int>(output->size() - header));
+            if (size <= 0) return false;
+            output->resize(header + size);
+            break;
+        }
+#endif
+#ifdef LSMKVSTORE_HAVE_ZSTD
+        case kZstdCompression: {
+            output->resize(ZSTD_compressBound(n));
+            size_t size = ZSTD_compress(&(*output)[0], output->size(), data, n, ZSTD_CLEVEL_DEFAULT);
+            if (ZSTD_isError(size)) return false;
+            output->resize(size);
+            break;
+        }
+#endif
+        default:
+            return false;
+    }
+    return true;
+}
+
+bool Uncompress(CompressionType type, const char *data, size_t n, std::string *output) {
+    switch (type) {
+        case kNoCompression:
+            output->assign(data, n);
+            return true;
+        case kFastCompression:
+            return FastUncompress(data, n, output);
+#ifdef LSMKVSTORE_HAVE_LZ4
+        case kLZ4Compression: {
+            uint32_t raw_len;
+            const char *p = GetVarint32(data, data + n, &raw_len);
+            if (p == nullptr) return false;
+            output->resize(raw_len);
+            int size = LZ4_decompress_safe(p, &(*output)[0], static_cast<int>(data + n - p),
+                                           static_cast<int>(raw_len));
+            return size >= 0 && static_cast<uint32_t>(size) == raw_len;
+        }
+#endif
+#ifdef LSMKVSTORE_HAVE_ZSTD
+        case kZstdCompression: {
+            unsigned long long raw_len = ZSTD_getFrameContentSize(data, n);
+            if (raw_len == ZSTD_CONTENTSIZE_ERROR || raw_len == ZSTD_CONTENTSIZE_UNKNOWN) return false;
+            output->resize(raw_len);
+            size_t size = ZSTD_decompress(&(*output)[0], output->size(), data, n);
+            return !ZSTD_isError(size) && size == raw_len;
+        }
+#endif
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,70 @@
+#include "file_cache.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+RandomAccessFile::RandomAccessFile(const std::string &file_name) : size_(0) {
+    fd_ = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd_ >= 0 && ::fstat(fd_, &st) == 0) {
+        size_ = st.st_size;
+    }
+}
+
+RandomAccessFile::~RandomAccessFile() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool RandomAccessFile::Read(uint64_t offset, size_t n, char *buf) const {
+    return ReadFully(fd_, offset, n, buf);
+}
+
+void RandomAccessFile::ReadBatch(ReadRequest *reqs, size_t n) const {
+    for (size_t i = 0; i < n; ++i) reqs[i].fd = fd_;
+    if (fd_ < 0) {
+        for (size_t i = 0; i < n; ++i) reqs[i].ok = false;
+        return;
+    }
+    IoBackend::ForCurrentThread()->Read(reqs, n);
+}
+
+FileCache::FileCache(std::size_t capacity) : cache_(capacity) {}
+
+std::shared_ptr<RandomAccessFile> FileCache::Open(const std::string &file_name) {
+    std::shared_ptr<RandomAccessFile> file;
+    if (cache_.TryGet(file_name, &file)) return file;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto iter = retained_.find(file_name);
+        if (iter != retained_.end()) return iter->second;
+    }
+
+    // 两个线程同时打开同一个文件时，后加入缓存的句柄替换先加入的，先打开的句柄在用完后关闭
+    file = std::make_shared<RandomAccessFile>(file_name);
+    if (file->IsOpen()) cache_.Put(file_name, file);
+    return file;
+}
+
+void FileCache::Evict(const std::string &file_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (pins_.count(file_name) != 0 && retained_.count(file_name) == 0) {
+        std::shared_ptr<RandomAccessFile> file;
+        if (!cache_.TryGet(file_name, &file)) file = std::make_shared<RandomAccessFile>(file_name);
+        if (file->IsOpen()) retained_.emplace(file_name, std::move(file));
+    }
+    cache_.Remove(file_name);
+}
+
+void FileCache::Pin(const std::string &file_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++pins_[file_name];
+}
+
+void FileCache::Unpin(const std::string &file_name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = pins_.find(file_name);
+    if (iter == pins_.end() || --iter->second > 0) return;
+    pins_.erase(iter);
+    retained_.erase(file_name);
+}
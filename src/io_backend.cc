@@ -0,0 +1,386 @@
+#include "io_backend.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define LSMKVSTORE_HAVE_IO_URING 1
+#endif
+
+#include "options.h"
+
+bool ReadFully(int fd, uint64_t offset, size_t n, char *buf) {
+    if (fd < 0) return false;
+    while (n > 0) {
+        ssize_t r = ::pread(fd, buf, n, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        buf += r;
+        offset += r;
+        n -= r;
+    }
+    return true;
+}
+
+bool WriteFully(int fd, uint64_t offset, const char *data, size_t n) {
+    if (fd < 0) return false;
+    while (n > 0) {
+        ssize_t r = ::pwrite(fd, data, n, offset);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        data += r;
+        offset += r;
+        n -= r;
+    }
+    return true;
+}
+
+void IoBackend::MarkWriteFailed(int fd) {
+    if (std::find(failed_fds_.begin(), failed_fds_.end(), fd) == failed_fds_.end()) failed_fds_.push_back(fd);
+}
+
+bool IoBackend::TakeWriteStatus(int fd) {
+    auto iter = std::find(failed_fds_.begin(), failed_fds_.end(), fd);
+    if (iter == failed_fds_.end()) return true;
+    failed_fds_.erase(iter);
+    return false;
+}
+
+// 用pread依次完成一批读请求
+static void ReadAll(ReadRequest *reqs, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        reqs[i].ok = ReadFully(reqs[i].fd, reqs[i].offset, reqs[i].n, reqs[i].buf);
+    }
+}
+
+/**
+ * @brief 阻塞的pread/pwrite实现，写请求在Write中直接完成
+ */
+class PosixIoBackend : public IoBackend {
+public:
+    void Read(ReadRequest *reqs, size_t n) override { ReadAll(reqs, n); }
+
+    void Write(int fd, uint64_t offset, std::string data) override {
+        if (!WriteFully(fd, offset, data.data(), data.size())) MarkWriteFailed(fd);
+    }
+
+    bool WaitForWrites(int fd) override { return TakeWriteStatus(fd); }
+
+    const char *Name() const override { return "posix"; }
+};
+
+#ifdef LSMKVSTORE_HAVE_IO_URING
+/**
+ * @brief 直接使用io_uring系统调用的实现，不依赖liburing
+ * @details 提交队列(SQ)和完成队列(CQ)是与内核共享的环形缓冲区：填写SQE后移动SQ的tail，
+ *          一次io_uring_enter提交所有新的SQE并可选地等待完成；内核把结果写入CQE后移动CQ的tail。
+ *          user_data的最高位区分读写请求，其余位为读请求在本批中的序号或写请求的槽位。
+ *          部分读写和内核返回的错误用阻塞的pread/pwrite补全或重试。
+ *          io_uring_enter返回无法重试的错误后不再使用io_uring，之后的请求都用pread/pwrite完成
+ */
+class IoUringBackend : public IoBackend {
+public:
+    IoUringBackend() : ring_fd_(-1), sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED), sqes_(nullptr), sq_size_(0),
+                       cq_size_(0), sqes_size_(0), depth_(0), to_submit_(0), inflight_(0), reads_(nullptr),
+                       reads_done_(0), failed_(false) {}
+
+    ~IoUringBackend() override {
+        if (ring_fd_ >= 0) {
+            while (free_slots_.size() < writes_.size() && ReapOne(true)) {}
+            if (sqes_ != nullptr) ::munmap(sqes_, sqes_size_);
+            if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_) ::munmap(cq_ptr_, cq_size_);
+            if (sq_ptr_ != MAP_FAILED) ::munmap(sq_ptr_, sq_size_);
+            ::close(ring_fd_);
+        }
+    }
+
+    /**
+     * @brief 创建io_uring实例并映射共享的队列
+     * @return false内核不支持或被禁止使用io_uring
+     */
+    bool Init(unsigned depth) {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, depth, &params));
+        if (ring_fd_ < 0) return false;
+
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                         IORING_OFF_SQ_RING);
+        if (sq_ptr_ == MAP_FAILED) return false;
+        cq_ptr_ = single_mmap ? sq_ptr_ : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                                                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) return false;
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void *sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                            IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+        sqes_ = static_cast<struct io_uring_sqe *>(sqes);
+
+        char *sq = static_cast<char *>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        char *cq = static_cast<char *>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // 正在进行的请求数不超过SQ的大小，CQ至少与SQ一样大，不会溢出
+        depth_ = params.sq_entries;
+        writes_.resize(depth_);
+        for (unsigned i = 0; i < depth_; ++i) free_slots_.push_back(depth_ - 1 - i);
+        return true;
+    }
+
+    void Read(ReadRequest *reqs, size_t n) override {
+        if (failed_) {
+            ReadAll(reqs, n);
+            return;
+        }
+        for (size_t i = 0; i < n; ++i) reqs[i].ok = false;
+        reads_ = reqs;
+        reads_done_ = 0;
+        size_t next = 0;
+        while (reads_done_ < n) {
+            while (next < n && inflight_ < depth_) {
+                Prepare(IORING_OP_READ, reqs[next].fd, reqs[next].buf, reqs[next].n, reqs[next].offset, next);
+                ++next;
+            }
+            if (!Submit(1)) break;
+            while (ReapOne(false)) {}
+        }
+        reads_ = nullptr;
+        // io_uring出错时还没有填写SQE的请求用pread完成，已提交但没有完成事件的请求保持失败
+        ReadAll(reqs + next, n - next);
+    }
+
+    void Write(int fd, uint64_t offset, std::string data) override {
+        while (!failed_ && free_slots_.empty()) ReapOne(true);
+        if (failed_) {
+            if (!WriteFully(fd, offset, data.data(), data.size())) MarkWriteFailed(fd);
+            return;
+        }
+        unsigned slot = free_slots_.back();
+        free_slots_.pop_back();
+        PendingWrite &write = writes_[slot];
+        write.fd = fd;
+        write.offset = offset;
+        write.data = std::move(data);
+        write.busy = true;
+        Prepare(IORING_OP_WRITE, fd, &write.data[0], write.data.size(), offset, kWriteFlag | slot);
+        Submit(0);
+    }
+
+    bool WaitForWrites(int fd) override {
+        while (HasPendingWrite(fd) && ReapOne(true)) {}
+        return TakeWriteStatus(fd);
+    }
+
+    const char *Name() const override { return "io_uring"; }
+
+private:
+    static const uint64_t kWriteFlag = 1ULL << 63;
+
+    struct PendingWrite {
+        int fd;
+        uint64_t offset;
+        std::string data;
+        bool busy = false;  // 槽位是否被正在进行的写请求占用
+    };
+
+    bool HasPendingWrite(int fd) const {
+        for (const PendingWrite &write : writes_) {
+            if (write.busy && write.fd == fd) return true;
+        }
+        return false;
+    }
+
+    // 填写一个SQE，调用者保证正在进行的请求数小于depth_，SQ不会满
+    void Prepare(uint8_t opcode, int fd, char *buf, size_t n, uint64_t offset, uint64_t user_data) {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        struct io_uring_sqe *sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uint64_t>(buf);
+        sqe->len = static_cast<uint32_t>(n);
+        sqe->off = offset;
+        sqe->user_data = user_data;
+        sq_array_[index] = index;
+        // 内核看到新的tail之前SQE必须已经写好
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+        ++inflight_;
+    }
+
+    // 提交所有新的SQE，并等待至少wait_nr个请求完成。返回无法重试的错误时调用Fail并返回false
+    bool Submit(unsigned wait_nr) {
+        if (failed_) return false;
+        if (inflight_ == 0) return true;
+        unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+        while (true) {
+            long r = ::syscall(__NR_io_uring_enter, ring_fd_, to_submit_, wait_nr, flags, nullptr, 0);
+            if (r >= 0) {
+                to_submit_ -= std::min<unsigned>(to_submit_, static_cast<unsigned>(r));
+                if (to_submit_ == 0 || wait_nr == 0) return true;
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                Fail();
+                return false;
+            }
+        }
+    }
+
+    // 停止使用io_uring。内核还没有取走的SQE撤回并用pread/pwrite完成，CQ中已有的完成事件照常处理；
+    // 其余已提交的请求不会再收到完成事件：读请求保持失败，写请求记为失败，数据保留到析构，避免内核仍在读取
+    void Fail() {
+        failed_ = true;
+        unsigned tail = *sq_tail_;
+        unsigned pending = to_submit_;
+        __atomic_store_n(sq_tail_, tail - pending, __ATOMIC_RELEASE);
+        to_submit_ = 0;
+        for (unsigned i = pending; i > 0; --i) {
+            --inflight_;
+            Complete(sqes_[(tail - i) & sq_mask_].user_data, -EIO);
+        }
+        while (ReapOne(false)) {}
+        for (unsigned slot = 0; slot < writes_.size(); ++slot) {
+            if (writes_[slot].busy) {
+                MarkWriteFailed(writes_[slot].fd);
+                writes_[slot].busy = false;
+                free_slots_.push_back(slot);
+            }
+        }
+        inflight_ = 0;
+    }
+
+    // 处理一个完成事件，没有完成事件时wait为true则等待，否则返回false
+    bool ReapOne(bool wait) {
+        while (true) {
+            unsigned head = *cq_head_;
+            if (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe cqe = cqes_[head & cq_mask_];
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                --inflight_;
+                Complete(cqe.user_data, cqe.res);
+                return true;
+            }
+            if (!wait || inflight_ == 0 || !Submit(1)) return false;
+        }
+    }
+
+    void Complete(uint64_t user_data, int res) {
+        if (user_data & kWriteFlag) {
+            unsigned slot = static_cast<unsigned>(user_data & ~kWriteFlag);
+            PendingWrite &write = writes_[slot];
+            size_t done = (res > 0) ? static_cast<size_t>(res) : 0;
+            if (done < write.data.size() &&
+                !WriteFully(write.fd, write.offset + done, write.data.data() + done, write.data.size() - done)) {
+                MarkWriteFailed(write.fd);
+            }
+            write.data = std::string();
+            write.busy = false;
+            free_slots_.push_back(slot);
+            return;
+        }
+
+        ReadRequest &req = reads_[user_data];
+        if (res < 0) {
+            req.ok = ReadFully(req.fd, req.offset, req.n, req.buf);    // 内核返回错误时用pread重试一次
+        } else if (static_cast<size_t>(res) < req.n) {
+            req.ok = res > 0 && ReadFully(req.fd, req.offset + res, req.n - res, req.buf + res);
+        } else {
+            req.ok = true;
+        }
+        ++reads_done_;
+    }
+
+    int ring_fd_;
+    void *sq_ptr_;
+    void *cq_ptr_;
+    struct io_uring_sqe *sqes_;
+    size_t sq_size_;
+    size_t cq_size_;
+    size_t sqes_size_;
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned sq_mask_;
+    unsigned *sq_array_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned cq_mask_;
+    struct io_uring_cqe *cqes_;
+    unsigned depth_;
+    unsigned to_submit_;                // 已填写但还没有提交给内核的SQE数
+    unsigned inflight_;                 // 已填写但还没有处理完成事件的请求数
+    ReadRequest *reads_;                // 当前批次的读请求
+    size_t reads_done_;
+    std::vector<PendingWrite> writes_;  // 正在进行的写请求，按槽位存放
+    std::vector<unsigned> free_slots_;
+    bool failed_;                       // io_uring_enter是否返回过无法重试的错误
+};
+#endif
+
+std::unique_ptr<IoBackend> IoBackend::Create(bool use_io_uring, unsigned depth) {
+#ifdef LSMKVSTORE_HAVE_IO_URING
+    if (use_io_uring) {
+        std::unique_ptr<IoUringBackend> backend(new IoUringBackend());
+        if (backend->Init(depth)) return backend;
+    }
+#endif
+    return std::unique_ptr<IoBackend>(new PosixIoBackend());
+}
+
+IoBackend *IoBackend::ForCurrentThread() {
+    thread_local std::unique_ptr<IoBackend> backend = Create(options::kUseIoUring, options::kIoQueueDepth);
+    return backend.get();
+}
+
+WritableFile::WritableFile(const std::string &file_name, RateLimiter *rate_limiter, IoPriority priority)
+    : offset_(0), backend_(IoBackend::ForCurrentThread()),
+      rate_limiter_(rate_limiter), priority_(priority) {
+    fd_ = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    buffer_.reserve(options::kWritableFileBufferSize);
+}
+
+WritableFile::~WritableFile() {
+    if (fd_ >= 0) Close();
+}
+
+void WritableFile::Append(const char *data, size_t n) {
+    buffer_.append(data, n);
+    if (buffer_.size() >= options::kWritableFileBufferSize) Flush();
+}
+
+void WritableFile::Flush() {
+    if (buffer_.empty() || fd_ < 0) return;
+    size_t size = buffer_.size();
+    if (rate_limiter_ != nullptr) rate_limiter_->Request(size, priority_);
+    std::string data;
+    data.reserve(options::kWritableFileBufferSize);
+    data.swap(buffer_);
+    backend_->Write(fd_, offset_, std::move(data));
+    offset_ += size;
+}
+
+bool WritableFile::Close() {
+    if (fd_ < 0) return false;
+    Flush();
+    bool ok = backend_->WaitForWrites(fd_);
+    ok = (::fdatasync(fd_) == 0) && ok;
+    ok = (::close(fd_) == 0) && ok;
+    fd_ = -1;
+    return ok;
+}
@@ -12,89 +12,398 @@ inline int GetFileNum(const std::string file_name) {
     return std::stoi(str);
 }
 
+/**
+ * @brief 获取WAL文件名中包含的序号(1.log, 2.log,...)
+ */
+inline uint64_t GetWalNum(const std::string file_name) {
+    return std::stoull(file_name.substr(0, file_name.find('.')));
+}
+
 /**
  * @details 初始化成员变量
  * 将dir目录下的所有SST文件的元信息缓存到sstable_meta_info_中
- * 记录level_num_vec_
+ * 回放WAL目录下的WAL文件，恢复上次关闭前未落盘的写入
  */
-KVStore::KVStore(const std::string& dir) : KVStoreAPI(dir), cache_(options::kCacheCap) {
+KVStore::KVStore(const std::string& dir, options::WalSyncMode wal_sync_mode, options::CompactionStyle compaction_style)
+    : KVStoreAPI(dir), cache_(options::kCacheCap) {
     mem_table_ = std::make_shared<SkipList>();
     dir_ = dir;
-    kvstore_mode_ = normal;
-    level_num_vec_.emplace_back(0);  // 没有这行的话会出现段错误
-    Reset();   // todo 不清空data文件夹的话测试有时会被杀死
+    time_stamp_ = 0;
+    wal_num_ = 0;
+    last_sequence_ = 0;
+    wal_sync_mode_ = wal_sync_mode;
+    compaction_style_ = compaction_style;
+    flush_scheduled_ = false;
+    bg_error_ = false;
+    bg_compactions_ = 0;
+    if (!utils::DirExists(dir_)) utils::MkDir(dir_.c_str());
+
+    LoadTables();
+    Recover();
+}
+
+/**
+ * @brief 执行完已提交的写任务，将内存中的数据dump到L0层，并等待所有compaction任务结束
+*/
+KVStore::~KVStore() {
+    // 线程池中已提交的PutTask、DelTask、WriteTask全部执行完，之后不会再有新的写入
+    pool_.Close();
 
+    // 独占写入队列，等待正在进行的组提交结束
+    Writer w;
+    w.exclusive = true;
+    {
+        std::unique_lock<std::mutex> writers_lock(writers_mutex_);
+        writers_.push_back(&w);
+        while (&w != writers_.front()) {
+            w.cv.wait(writers_lock);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_var_.wait(lock, [&] { return (immutable_tables_.empty() || bg_error_) && !flush_scheduled_; });
+    // mem_table_已经落盘时WAL文件不再需要。出错时保留所有WAL文件，重新打开时恢复
+    bool stored = !bg_error_ && (mem_table_->GetSize() == 0 || StoreToLevel0(mem_table_.get()));
+    std::string wal_file = wal_->GetFileName();
+    wal_.reset();
+    if (stored) utils::RmFile(wal_file.c_str());
+    lock.unlock();
+
+    // 任务结束时会继续提交下一层的compaction，计数为0时所有层都已合并完成
+    std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    MaybeScheduleCompaction();
+    bg_cv_.wait(meta_lock, [&] { return bg_compactions_ == 0; });
+}
+
+void KVStore::LoadTables() {
     std::vector<std::string> dirs;
-    int dir_num = utils::ScanDir(dir, dirs);
+    int dir_num = utils::ScanDir(dir_, dirs);
     for (int i = 0; i < dir_num; ++i) {
-        sstable_meta_info_.emplace_back();
-        std::string dir_path = dir + "/" + dirs[i];
-        std::vector<std::string> files;
-        int file_num = utils::ScanDir(dir_path, files);     // files是有序的
-        // 填充level_num_vec_
-        if (file_num > 0) {
-            level_num_vec_.emplace_back(GetFileNum(files.back()));
-        } else {
-            level_num_vec_.emplace_back(0);
+        if (dirs[i].compare(0, 5, "level") != 0) continue;     // 跳过WAL目录
+        int level = std::stoi(dirs[i].substr(5));
+        if ((int)sstable_meta_info_.size() <= level) {
+            sstable_meta_info_.resize(level + 1);
+            level_num_vec_.resize(level + 1, 0);
         }
-        // 填充sstable_meta_info_
+
+        std::string dir_path = dir_ + "/" + dirs[i];
+        std::vector<std::string> files;
+        int file_num = utils::ScanDir(dir_path, files);
         for (int j = 0; j < file_num; ++j) {
-            std::string file_name = dir_path + "/" + files[j];
-            TableCache tc(file_name);
-            sstable_meta_info_[i].insert(std::move(tc));
+            // 按字典序排列时SSTable10排在SSTable9前面，所以逐个比较取最大序号
+            level_num_vec_[level] = std::max(level_num_vec_[level], GetFileNum(files[j]));
+            TableCache tc(dir_path + "/" + files[j], &file_cache_, &block_cache_);
+            time_stamp_ = std::max(time_stamp_, tc.GetTimeStamp());
+            last_sequence_ = std::max(last_sequence_.load(), tc.GetMaxSequence());
+            sstable_meta_info_[level].insert(std::move(tc));
         }
     }
 
     if (sstable_meta_info_.empty()) {
         sstable_meta_info_.emplace_back();
+        level_num_vec_.emplace_back(0);
+    }
+    for (int level = 0; level < (int)sstable_meta_info_.size(); ++level) {
+        RebuildLevelFiles(level);
     }
 }
 
-/**
- * @brief 将内存中的数据dump到L0层，若L0层SST文件数量超过限制，则触发Compaction
-*/
-KVStore::~KVStore() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    //cond_var_.wait(lock, [&] { return kvstore_mode_ == normal; });
-    cond_var_.wait(lock, [&] { return immutable_table_ == nullptr; });
-    kvstore_mode_ = exits;
+void KVStore::RebuildLevelFiles(int level) {
+    if (level_files_.size() < sstable_meta_info_.size()) {
+        level_files_.resize(sstable_meta_info_.size());
+    }
+    LevelFiles &level_files = level_files_[level];
+    const std::set<TableCache> &tables = sstable_meta_info_[level];
+    level_files.files.clear();
+    level_files.max_keys.clear();
+
+    if (level == 0) {
+        // sstable_meta_info_按时间戳从小到大排列，反向遍历得到从新到旧的顺序
+        level_files.files.assign(tables.rbegin(), tables.rend());
+        return;
+    }
+
+    level_files.files.assign(tables.begin(), tables.end());
+    std::sort(level_files.files.begin(), level_files.files.end(),
+              [](const TableCache &a, const TableCache &b) { return a.GetMinKey() < b.GetMinKey(); });
+    level_files.max_keys.reserve(level_files.files.size());
+    for (const TableCache &table : level_files.files) {
+        level_files.max_keys.push_back(table.GetMaxKey());
+    }
+}
+
+void KVStore::Recover() {
+    std::string wal_dir = dir_ + "/wal";
+    if (!utils::DirExists(wal_dir)) utils::MkDir(wal_dir.c_str());
+
+    std::vector<std::string> files;
+    utils::ScanDir(wal_dir, files);
+    std::vector<uint64_t> wal_nums;
+    for (const auto &file : files) {
+        wal_nums.emplace_back(GetWalNum(file));
+    }
+    std::sort(wal_nums.begin(), wal_nums.end());    // 按写入顺序回放
+
+    bool flushed = false;
+    auto table = std::make_unique<SkipList>();
+    auto flush = [&]() {
+        // 写入失败时保留所有WAL文件，不能在缺少数据的情况下打开
+        if (!StoreToLevel0(table.get())) {
+            throw std::runtime_error("KVStore failed to write level0 file while recovering from WAL");
+        }
+        table = std::make_unique<SkipList>();
+        flushed = true;
+    };
+
+    std::string payload, val;
+    for (uint64_t num : wal_nums) {
+        std::string file_name = wal_dir + "/" + std::to_string(num) + ".log";
+        WalReader reader(file_name);
+        while (reader.ReadRecord(&payload)) {
+            if (payload.size() < sizeof(SequenceNumber)) continue;
+            SequenceNumber seq;
+            memcpy(&seq, payload.data(), sizeof(SequenceNumber));
+            size_t pos = sizeof(SequenceNumber);
+            wal::RecordType type;
+            int64_t key;
+            while (wal::DecodeRecord(payload, &pos, &type, &key, &val)) {
+                if (table->ApproximateMemoryUsage() + val.size() > options::kMemTable &&
+                    table->GetSize() > 0) {
+                    flush();
+                }
+                table->Put(key, seq, (type == wal::kTypeDeletion) ? kTypeDeletion : kTypeValue, val);
+                last_sequence_ = std::max(last_sequence_.load(), seq);
+                ++seq;
+            }
+        }
+        wal_num_ = std::max(wal_num_, num);
+    }
+    if (table->GetSize() > 0) flush();
+
+    // 回放的数据都已写入level0，删除旧的WAL文件
+    for (uint64_t num : wal_nums) {
+        utils::RmFile((wal_dir + "/" + std::to_string(num) + ".log").c_str());
+    }
+    NewWal();
+
+    if (flushed) {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        MaybeScheduleCompaction();
+    }
+}
+
+void KVStore::NewWal() {
+    std::string file_name = dir_ + "/wal/" + std::to_string(++wal_num_) + ".log";
+    wal_.reset(new WalWriter(file_name, wal_sync_mode_));
+}
+
+bool KVStore::StoreToLevel0(SkipList *table) {
     std::string path = dir_ + "/level0";
-    mem_table_->Store(++level_num_vec_[0], path);
-    lock.unlock();
-    if (sstable_meta_info_[0].size() >= options::SSTMaxNumForLevel(0)) {
-        MajorCompaction(1);
+    if (!utils::DirExists(path)) utils::MkDir(path.c_str());
+
+    // universal模式下compaction也会向level0写入文件，先分配文件序号。写文件时不需要阻塞读线程
+    int file_num;
+    {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        file_num = ++level_num_vec_[0];
     }
+    // 文件和所在目录都刷盘后才能删除对应的WAL文件
+    std::string file_name = path + "/SSTable" + std::to_string(file_num) + ".sst";
+    if (!table->Store(file_num, path, ++time_stamp_, SmallestSnapshot(), &rate_limiter_) ||
+        !utils::SyncDir(path)) {
+        utils::RmFile(file_name.c_str());
+        return false;
+    }
+
+    TableCache tc(file_name, &file_cache_, &block_cache_);
+    std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    sstable_meta_info_[0].insert(std::move(tc));
+    RebuildLevelFiles(0);
+    return true;
+}
+
+SequenceNumber KVStore::SmallestSnapshot() {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return snapshots_.Empty() ? last_sequence_.load() : snapshots_.Oldest()->GetSequence();
+}
+
+const Snapshot *KVStore::GetSnapshot() {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    return snapshots_.New(last_sequence_.load());
+}
+
+void KVStore::ReleaseSnapshot(const Snapshot *snapshot) {
+    std::lock_guard<std::mutex> lock(snapshot_mutex_);
+    snapshots_.Delete(snapshot);
 }
 
 void KVStore::Put(uint64_t key, const std::string& val, bool to_cache) {
-    std::unique_lock<std::shared_mutex> lock(rw_mutex_); // 只有一个线程能写
+    WriteBatch batch;
+    batch.Put(key, val);
+    Write(batch, to_cache);
+}
+
+bool KVStore::Write(const WriteBatch &batch, bool to_cache) {
+    if (batch.Count() == 0) return true;
+    Writer w;
+    w.batch = &batch;
+    w.to_cache = to_cache;
+    return GroupCommit(&w);
+}
 
-    std::string cur_val = mem_table_->Get(key);
-    if (!cur_val.empty()) {     // 如果存在这个key，替换value
-        mem_table_->memory_ += strlen(val.c_str()) - strlen(cur_val.c_str());
-    } else {        // 如果不存在这个key，插入
-        mem_table_->memory_ += strlen(val.c_str()) + 1 + 12; // '\0' + (key + offset)
+bool KVStore::GroupCommit(Writer *w) {
+    std::unique_lock<std::mutex> lock(writers_mutex_);
+    writers_.push_back(w);
+    while (true) {
+        while (!w->done && w->leader == nullptr && w != writers_.front()) {
+            w->cv.wait(lock);
+        }
+        if (w->leader == nullptr) break;
+
+        // 由leader指派，与同组的其它写请求并发写入mem_table_，leader持有rw_mutex_读锁
+        Writer *leader = w->leader;
+        w->leader = nullptr;
+        lock.unlock();
+        ApplyBatch(w);
+        lock.lock();
+        if (--leader->pending_apply == 0) leader->cv.notify_one();
+    }
+    if (w->done) return w->ok;  // 已经被其它leader合并写入
+
+    // w成为leader，合并队列中排在其后的写请求
+    std::vector<Writer *> group;
+    size_t group_size = 0;
+    size_t group_count = 0;
+    for (Writer *x : writers_) {
+        if (x->exclusive) break;
+        size_t size = x->batch->ApproximateSize();
+        if (!group.empty() && group_size + size > options::kMaxGroupCommitSize) break;
+        group.emplace_back(x);
+        group_size += size;
+        group_count += x->batch->Count();
+    }
+    lock.unlock();
+
+    // 为组内的操作分配连续的序列号，WAL记录开头是第一个操作的序列号
+    SequenceNumber sequence = last_sequence_.load(std::memory_order_relaxed) + 1;
+    std::string payload;
+    payload.reserve(sizeof(SequenceNumber) + group_size);
+    payload.append((const char *)&sequence, sizeof(SequenceNumber));
+    for (Writer *x : group) {
+        x->sequence = sequence;
+        sequence += x->batch->Count();
+        payload.append(x->batch->Rep());
     }
 
-    // 如果mem_table_满了，转换为immutable_table_并创建线程写入磁盘
-    if (mem_table_->memory_ > options::kMemTable) {
-        // 如果immutable_table_非空，先等它写入到level0
-        if (immutable_table_ != nullptr) {
-            std::unique_lock<std::mutex> lk(mutex_);
-            cond_var_.wait(lk, [&] { return immutable_table_ == nullptr; });
+    // WAL写入失败后记录可能已经部分或全部写入文件，之后的写入都拒绝，不会在坏记录之后追加记录，
+    // 也不会把这组的序列号再分配给下一组
+    bool ok = !bg_error_.load(std::memory_order_acquire);
+    if (ok) {
+        // 编码后每条记录的大小(13 + val长度)加上序列号的8字节，近似为它写入mem_table_后Arena增加的内存
+        ok = MakeRoomForWrite(group_size + group_count * sizeof(SequenceNumber)) && wal_->AddRecord(payload);
+        if (!ok) bg_error_.store(true, std::memory_order_release);
+    }
+    if (ok) {
+        // 跳表支持并发写入，读锁只用来防止mem_table_被切换，不会阻塞Get
+        std::shared_lock<std::shared_mutex> rw_lock(rw_mutex_);
+        if (options::kAllowConcurrentMemTableWrite && group.size() > 1 && !KeysOverlap(group)) {
+            lock.lock();
+            w->pending_apply = group.size() - 1;
+            for (Writer *x : group) {
+                if (x == w) continue;
+                x->leader = w;
+                x->cv.notify_one();
+            }
+            lock.unlock();
+
+            ApplyBatch(w);
+
+            lock.lock();
+            w->cv.wait(lock, [&] { return w->pending_apply == 0; });
+            lock.unlock();
+        } else {
+            for (Writer *x : group) ApplyBatch(x);
         }
+    }
+    // 整组写入完成后才对读线程可见。WAL写入失败时不写入mem_table_
+    if (ok) last_sequence_.store(sequence - 1, std::memory_order_release);
 
-        immutable_table_ = mem_table_;
-        mem_table_ = std::make_shared<SkipList>();
-        mem_table_->memory_ += strlen(val.c_str()) + 1 + 12;
+    lock.lock();
+    for (Writer *x : group) {
+        writers_.pop_front();
+        x->ok = ok;
+        if (x != w) {
+            x->done = true;
+            x->cv.notify_one();
+        }
+    }
+    if (!writers_.empty()) writers_.front()->cv.notify_one();   // 唤醒下一个leader
+    return ok;
+}
 
-        std::thread compact_thread(&KVStore::MinorCompaction, this);
-        compact_thread.detach();
+bool KVStore::KeysOverlap(const std::vector<Writer *> &group) {
+    std::unordered_set<int64_t> seen;
+    std::vector<int64_t> keys;
+    for (Writer *x : group) {
+        const std::string &rep = x->batch->Rep();
+        size_t pos = 0;
+        int64_t key;
+        keys.clear();
+        while (wal::DecodeRecordKey(rep, &pos, &key)) {
+            if (seen.count(key)) return true;
+            keys.emplace_back(key);
+        }
+        seen.insert(keys.begin(), keys.end());   // 同一个写请求内的重复key是顺序写入的
     }
+    return false;
+}
 
-    mem_table_->Put(key, val);
+void KVStore::ApplyBatch(const Writer *w) {
+    const std::string &rep = w->batch->Rep();
+    size_t pos = 0;
+    wal::RecordType type;
+    int64_t key;
+    std::string val;
+    SequenceNumber seq = w->sequence;
+    while (wal::DecodeRecord(rep, &pos, &type, &key, &val)) {
+        if (type == wal::kTypeDeletion) {
+            mem_table_->Put(key, seq++, kTypeDeletion, "");
+            cache_.Remove(key);
+        } else {
+            mem_table_->Put(key, seq++, kTypeValue, val);
+            if (w->to_cache) {
+                cache_.Put(key, val);
+            } else {
+                cache_.Remove(key);     // 避免缓存中的旧值被读到
+            }
+        }
+    }
+}
+
+bool KVStore::MakeRoomForWrite(size_t size) {
+    if (mem_table_->ApproximateMemoryUsage() + size <= options::kMemTable || mem_table_->GetSize() == 0) {
+        return true;
+    }
+
+    // 只有immutable memtable的数量达到上限时才等待flush，其余情况不会阻塞写入。flush失败后不再等待
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_var_.wait(lock, [&] { return immutable_tables_.size() < options::kMaxWriteBufferNumber - 1 || bg_error_; });
+    if (bg_error_) return false;
+    lock.unlock();
 
-    if (to_cache) cache_.Put(key, val);
+    // 将mem_table_加入immutable_tables_队尾
+    std::unique_lock<std::shared_mutex> rw_lock(rw_mutex_);
+    lock.lock();
+    immutable_tables_.push_back(mem_table_);
+    imm_wal_files_.push_back(wal_->GetFileName());
+    mem_table_ = std::make_shared<SkipList>();
+    NewWal();
+
+    if (!flush_scheduled_) {
+        flush_scheduled_ = true;
+        flush_pool_.Enqueue(&KVStore::MinorCompaction, this);
+    }
+    return true;
 }
 
 // 将Put函数封装为任务，以便丢进线程池
@@ -102,65 +411,223 @@ void KVStore::PutTask(uint64_t key, const std::string& val, bool to_cache) {
     pool_.Enqueue(&KVStore::Put, this, key, val, to_cache);
 }
 
-std::string KVStore::Get(uint64_t key) {
+// 将Write函数封装为任务，以便丢进线程池
+void KVStore::WriteTask(const WriteBatch &batch, bool to_cache) {
+    pool_.Enqueue(&KVStore::Write, this, batch, to_cache);
+}
+
+std::string KVStore::Get(uint64_t key, const Snapshot *snapshot) {
     std::shared_lock<std::shared_mutex> lock(rw_mutex_);    // 多个线程能同时读
 
-    // 1、如果cache中有，则直接返回
-    if (cache_.Cached(key)) return cache_.Get(key);
+    // 1、如果cache中有，则直接返回。cache_中是最新的数据，用快照读取时不能使用
+    std::string value;
+    if (snapshot == nullptr && cache_.TryGet(key, &value)) return value;
 
-    // 2、查mem_table_
-    std::string val = mem_table_->Get(key);
-    if (!val.empty()) {
-        if (val == options::kDelSign) {
-            return "";
-        } else {
-            return val;
+    SequenceNumber seq = (snapshot != nullptr) ? snapshot->GetSequence()
+                                               : last_sequence_.load(std::memory_order_acquire);
+
+    // 2、查mem_table_，找到的版本是删除标记时返回""
+    ValueType type;
+    std::string val;
+    if (mem_table_->Get(key, seq, &type, &val)) {
+        return (type == kTypeValue) ? val : "";
+    }
+
+    // 3、从新到旧查immutable_tables_
+    for (auto iter = immutable_tables_.rbegin(); iter != immutable_tables_.rend(); ++iter) {
+        if ((*iter)->Get(key, seq, &type, &val)) {
+            return (type == kTypeValue) ? val : "";
         }
     }
 
-    // 3、查immutable_table_
-    if (immutable_table_ != nullptr) {
-        val = immutable_table_->Get(key);
-        if (!val.empty()) {
-            if (val == options::kDelSign) {
-                return "";
-            } else {
-                return val;
+    // 4、查SST文件
+    // immutable memtable总是先写入level0再出队，所以此时释放rw_mutex_不会漏掉数据，
+    // 也不会因为等待compaction而阻塞MemTable的切换
+    lock.unlock();
+    // level0从新到旧查找每个文件，其他层二分查找第一个最大key不小于key的文件，至多查找一个文件
+    std::shared_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    int64_t target = key;
+    for (size_t level = 0; level < level_files_.size(); ++level) {
+        const LevelFiles &level_files = level_files_[level];
+        if (level == 0) {
+            for (const auto &table : level_files.files) {
+                if (table.GetValue(target, seq, &type, &val)) {
+                    return (type == kTypeValue) ? val : "";
+                }
             }
+            continue;
         }
 
-        while (kvstore_mode_ == compact) {
-            std::unique_lock<std::mutex> lk(mutex_);
-            cond_var_.wait(lk, [&] { return kvstore_mode_ == normal; });
+        auto iter = std::lower_bound(level_files.max_keys.begin(), level_files.max_keys.end(), target);
+        if (iter == level_files.max_keys.end()) continue;
+        const TableCache &table = level_files.files[iter - level_files.max_keys.begin()];
+        if (table.GetValue(target, seq, &type, &val)) {
+            return (type == kTypeValue) ? val : "";
         }
     }
 
-    // 4、查SST文件
-    for (const auto& table_list : sstable_meta_info_) {
-        for (const auto& table : table_list) {
-            val = table.GetValue(key);
-            if (!val.empty()) {
-                if (val == options::kDelSign) {
-                    return "";
-                } else {
-                    return val;
+    return "";
+}
+
+std::vector<std::string> KVStore::MultiGet(const std::vector<uint64_t> &keys, const Snapshot *snapshot) {
+    // 与Get一样按int64_t比较key，排序去重后每个key只查找一次
+    std::vector<int64_t> sorted(keys.begin(), keys.end());
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    std::vector<std::string> values(sorted.size());
+    std::vector<size_t> pending;    // 还没有找到的key在sorted中的序号，从小到大排列
+
+    // 1、在一次加锁中查缓存、mem_table_和immutable_tables_
+    std::shared_lock<std::shared_mutex> lock(rw_mutex_);
+    SequenceNumber seq = (snapshot != nullptr) ? snapshot->GetSequence()
+                                               : last_sequence_.load(std::memory_order_acquire);
+    ValueType type;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        uint64_t key = sorted[i];
+        if (snapshot == nullptr && cache_.TryGet(key, &values[i])) continue;
+        bool found = mem_table_->Get(sorted[i], seq, &type, &values[i]);
+        for (auto iter = immutable_tables_.rbegin(); !found && iter != immutable_tables_.rend(); ++iter) {
+            found = (*iter)->Get(sorted[i], seq, &type, &values[i]);
+        }
+        if (!found) {
+            pending.push_back(i);
+        } else if (type == kTypeDeletion) {
+            values[i].clear();
+        }
+    }
+    lock.unlock();
+
+    // 2、逐层查SST文件。同一层中可能包含剩余key的文件各为一组，第一组在当前线程查找，其余组并行查找
+    struct FileLookup {
+        explicit FileLookup(const TableCache *t) : table(t) {}
+
+        const TableCache *table;
+        std::vector<int64_t> keys;
+        std::vector<size_t> slots;  // 每个key在sorted中的序号
+        std::unique_ptr<bool[]> found;
+        std::vector<ValueType> types;
+        std::vector<std::string> vals;
+    };
+    std::shared_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    for (size_t level = 0; level < level_files_.size() && !pending.empty(); ++level) {
+        const LevelFiles &level_files = level_files_[level];
+        std::vector<FileLookup> lookups;
+        if (level == 0) {
+            // level0的文件key范围可能重叠，一个key可能出现在多个组中，按从新到旧的顺序采用第一个结果
+            for (const auto &table : level_files.files) {
+                FileLookup lookup(&table);
+                for (size_t i : pending) {
+                    if (sorted[i] >= table.GetMinKey() && sorted[i] <= table.GetMaxKey()) {
+                        lookup.keys.push_back(sorted[i]);
+                        lookup.slots.push_back(i);
+                    }
                 }
+                if (!lookup.keys.empty()) lookups.push_back(std::move(lookup));
+            }
+        } else {
+            // key和文件都是有序的，同时向后扫描即可把每个key分到第一个最大key不小于它的文件
+            size_t f = 0;
+            for (size_t i : pending) {
+                while (f < level_files.files.size() && level_files.max_keys[f] < sorted[i]) ++f;
+                if (f == level_files.files.size()) break;
+                const TableCache &table = level_files.files[f];
+                if (sorted[i] < table.GetMinKey()) continue;
+                if (lookups.empty() || lookups.back().table != &table) lookups.emplace_back(&table);
+                lookups.back().keys.push_back(sorted[i]);
+                lookups.back().slots.push_back(i);
             }
         }
+        if (lookups.empty()) continue;
+
+        auto run = [seq](FileLookup *lookup) {
+            size_t n = lookup->keys.size();
+            lookup->found.reset(new bool[n]);
+            lookup->types.resize(n);
+            lookup->vals.resize(n);
+            lookup->table->MultiGetValue(lookup->keys.data(), n, seq, lookup->found.get(), lookup->types.data(),
+                                         lookup->vals.data());
+        };
+        std::vector<std::future<void>> tasks;
+        for (size_t g = 1; g < lookups.size(); ++g) {
+            tasks.emplace_back(read_pool_.Enqueue(run, &lookups[g]));
+        }
+        run(&lookups[0]);
+        for (auto &task : tasks) task.get();
+
+        std::vector<bool> done(sorted.size(), false);
+        for (FileLookup &lookup : lookups) {
+            for (size_t j = 0; j < lookup.keys.size(); ++j) {
+                size_t slot = lookup.slots[j];
+                if (!lookup.found[j] || done[slot]) continue;
+                done[slot] = true;
+                if (lookup.types[j] == kTypeValue) values[slot] = std::move(lookup.vals[j]);
+            }
+        }
+        pending.erase(std::remove_if(pending.begin(), pending.end(), [&done](size_t i) { return done[i]; }),
+                      pending.end());
     }
+    meta_lock.unlock();
 
-    return "";
+    // 3、按输入的顺序返回结果
+    std::vector<std::string> results(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        int64_t key = keys[i];
+        results[i] = values[std::lower_bound(sorted.begin(), sorted.end(), key) - sorted.begin()];
+    }
+    return results;
 }
 
 // 将Get函数封装为任务，以便丢进线程池。返回一个包含key对应val的future对象
 std::future<std::string> KVStore::GetTask(uint64_t key) {
-    return pool_.Enqueue(&KVStore::Get, this, key);
+    return pool_.Enqueue(&KVStore::Get, this, key, static_cast<const Snapshot *>(nullptr));
+}
+
+std::unique_ptr<Iterator> KVStore::NewIterator(const Snapshot *snapshot) {
+    SequenceNumber seq = (snapshot != nullptr) ? snapshot->GetSequence()
+                                               : last_sequence_.load(std::memory_order_acquire);
+    std::vector<std::unique_ptr<InternalIterator>> children;
+    std::shared_lock<std::shared_mutex> lock(rw_mutex_);
+    children.emplace_back(new MemTableIterator(mem_table_, seq));
+    for (auto iter = immutable_tables_.rbegin(); iter != immutable_tables_.rend(); ++iter) {
+        children.emplace_back(new MemTableIterator(*iter, seq));
+    }
+
+    // 与Get相同，immutable memtable写入level0之前不会出队，先释放rw_mutex_不会漏掉数据
+    lock.unlock();
+    // level0的文件key范围可能重叠，每个文件一个迭代器，按从新到旧的顺序加入；
+    // 其他层每层一个LevelIterator，遍历到某个文件时才打开它
+    std::shared_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    for (size_t level = 0; level < level_files_.size(); ++level) {
+        const LevelFiles &level_files = level_files_[level];
+        if (level == 0) {
+            for (const auto &table : level_files.files) {
+                children.emplace_back(new TableIterator(table, seq, options::kIteratorFillCache));
+            }
+        } else if (!level_files.files.empty()) {
+            children.emplace_back(new LevelIterator(level_files.files, level_files.max_keys, seq,
+                                                    options::kIteratorFillCache));
+        }
+    }
+
+    return std::unique_ptr<Iterator>(
+        new StoreIterator(std::unique_ptr<InternalIterator>(new MergingIterator(std::move(children)))));
+}
+
+std::vector<std::pair<uint64_t, std::string>> KVStore::Scan(uint64_t lo, uint64_t hi, size_t limit,
+                                                            const Snapshot *snapshot) {
+    std::vector<std::pair<uint64_t, std::string>> result;
+    auto iter = NewIterator(snapshot);
+    for (iter->Seek(lo); iter->Valid() && result.size() < limit; iter->Next()) {
+        if (iter->Key() > (int64_t)hi) break;
+        result.emplace_back(iter->Key(), iter->Value());
+    }
+    return result;
 }
 
 bool KVStore::Del(uint64_t key, bool to_cache) {
-    Put(key, options::kDelSign);
-    if (to_cache) cache_.Remove(key);
-    return true;
+    WriteBatch batch;
+    batch.Del(key);
+    return Write(batch, to_cache);
 }
 
 // 将Del函数封装为任务，以便丢进线程池
@@ -169,266 +636,621 @@ void KVStore::DelTask(uint64_t key, bool to_cache) {
 }
 
 void KVStore::Reset() {
-    std::vector<std::string> dirs;
-    int dir_num = utils::ScanDir(dir_, dirs);
-    for (int i = 0; i < dir_num; ++i) {
-        std::string dir_path = dir_ + "/" + dirs[i];
-        std::vector<std::string> files;
-        int file_num = utils::ScanDir(dir_path, files);
-        for (int j = 0; j < file_num; ++j) {
-            utils::RmFile((dir_path + "/" + files[j]).c_str());
+    // 独占写入队列，保证没有正在进行的组提交
+    Writer w;
+    w.exclusive = true;
+    std::unique_lock<std::mutex> lock(writers_mutex_);
+    writers_.push_back(&w);
+    while (&w != writers_.front()) {
+        w.cv.wait(lock);
+    }
+    lock.unlock();
+
+    {
+        std::unique_lock<std::mutex> lk(mutex_);
+        cond_var_.wait(lk, [&] { return (immutable_tables_.empty() || bg_error_) && !flush_scheduled_; });
+    }
+    {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        bg_cv_.wait(meta_lock, [&] { return bg_compactions_ == 0; });
+    }
+
+    {
+        std::unique_lock<std::shared_mutex> rw_lock(rw_mutex_);
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+
+        wal_.reset();
+        std::vector<std::string> dirs;
+        int dir_num = utils::ScanDir(dir_, dirs);
+        for (int i = 0; i < dir_num; ++i) {
+            std::string dir_path = dir_ + "/" + dirs[i];
+            std::vector<std::string> files;
+            int file_num = utils::ScanDir(dir_path, files);
+            for (int j = 0; j < file_num; ++j) {
+                file_cache_.Evict(dir_path + "/" + files[j]);
+                utils::RmFile((dir_path + "/" + files[j]).c_str());
+            }
+            utils::RmDir(dir_path.c_str());
         }
-        utils::RmDir(dir_path.c_str());
+
+        mem_table_ = std::make_shared<SkipList>();
+        cache_.Clear();        // 与文件一起清空，之后的读取不会返回Reset之前的值
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            immutable_tables_.clear();      // 只在flush失败后非空，对应的WAL文件已经删除
+            imm_wal_files_.clear();
+        }
+        bg_error_ = false;     // 旧的文件已经全部删除，可以重新接受写入
+        sstable_meta_info_.assign(1, std::set<TableCache>());
+        level_files_.assign(1, LevelFiles());
+        level_num_vec_.assign(1, 0);
+        compacting_levels_.assign(1, false);
+        utils::MkDir((dir_ + "/wal").c_str());
+        NewWal();
     }
+
+    lock.lock();
+    writers_.pop_front();
+    if (!writers_.empty()) writers_.front()->cv.notify_one();
 }
 
 void KVStore::MinorCompaction() {
     std::unique_lock<std::mutex> lock(mutex_);
+    while (!immutable_tables_.empty()) {
+        std::shared_ptr<SkipList> table = immutable_tables_.front();
+        std::string wal_file = imm_wal_files_.front();
+        lock.unlock();
 
-    kvstore_mode_ = compact;
+        // level0文件(universal模式下为有序序列)过多时等待compaction，避免读放大无限增长
+        {
+            std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+            bg_cv_.wait(meta_lock, [&] { return L0Pressure() < options::kL0StopWritesTrigger || bg_error_; });
+        }
 
-    // 保存到level0层
-    std::string path = dir_ + "/level0";
-    if (!utils::DirExists(path)) utils::MkDir(path.c_str());
-    immutable_table_->Store(++level_num_vec_[0], path);
+        // 保存到level0层，并修改sstable_meta_info_。失败时保留immutable memtable和WAL文件，
+        // 之后的写入都失败，重新打开时从WAL恢复
+        if (bg_error_ || !StoreToLevel0(table.get())) {
+            bg_error_ = true;
+            lock.lock();
+            break;
+        }
 
-    // 修改sstable_meta_info_
-    std::string file_name = path + "/SSTable" + std::to_string(level_num_vec_[0]) + ".sst";
-    TableCache tc(file_name);
-    sstable_meta_info_[0].insert(std::move(tc));
+        // 检查是否需要compaction，compaction在后台进行，不等待其完成
+        {
+            std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+            MaybeScheduleCompaction();
+        }
 
-    // 检查level0层是否需要compaction
-    MajorCompaction(1);
+        // 已经落盘，删除对应的WAL文件，并从immutable_tables_中移除
+        utils::RmFile(wal_file.c_str());
+        std::unique_lock<std::shared_mutex> rw_lock(rw_mutex_);
+        lock.lock();
+        immutable_tables_.pop_front();
+        imm_wal_files_.pop_front();
+        rw_lock.unlock();
+        cond_var_.notify_all();
+    }
 
-    immutable_table_ = nullptr;
-    // std::cout << "immutable_table_ = nullptr;" << std::endl;
-    kvstore_mode_ = normal;
-    lock.unlock();
-    cond_var_.notify_one();
+    // 持有锁时通知，保证析构函数被唤醒时本任务已不再访问成员变量
+    flush_scheduled_ = false;
+    cond_var_.notify_all();
 }
 
-/**
- * @brief 更新minkey_sstindex
- * @param[in] kv_to_compact 被合并的键值对
- * @param[in] kv_to_compact_iter 被合并的键值对的迭代器
- * @param[in] minkey_sstindex 各个SST文件中的最小键及其所在的SST文件的索引
- * @param[in] index SST文件序号
- */
-static void Update(std::vector<std::map<int64_t, std::string>>& kv_to_compact,
-    std::vector<std::map<int64_t, std::string>::iterator>& kv_to_compact_iter,
-    std::map<int64_t, int>& minkey_sstindex, int index) {
-    while (kv_to_compact_iter[index] != kv_to_compact[index].end()) {
-        int64_t key = kv_to_compact_iter[index]->first;
-        if (minkey_sstindex.count(key) == 0) {
-            minkey_sstindex[key] = index;
-            break;
-        } else if (index > minkey_sstindex[key]) {
-            int temp_index = minkey_sstindex[key];
-            minkey_sstindex[key] = index;
-            Update(kv_to_compact, kv_to_compact_iter, minkey_sstindex, temp_index);
-            break;
+uint64_t KVStore::LevelBytes(int level) const {
+    uint64_t bytes = 0;
+    if (level < (int)sstable_meta_info_.size()) {
+        for (const auto &table : sstable_meta_info_[level]) {
+            bytes += table.GetFileSize();
         }
-        kv_to_compact_iter[index]++;
     }
+    return bytes;
 }
 
-void KVStore::MajorCompaction(int level) {
-    // 如果level-1层的SST文件数量小于上限，则不需要合并
-    int sst_num_for_levelminus1 = sstable_meta_info_[level - 1].size();
-    if (sst_num_for_levelminus1 <= options::SSTMaxNumForLevel(level - 1)) {
+std::vector<uint64_t> KVStore::LevelMaxBytes(int *base_level) const {
+    int last_level = NumLevels() - 1;
+    std::vector<uint64_t> max_bytes(last_level + 1, 0);
+    uint64_t base_bytes = options::kMaxBytesForLevelBase;
+    *base_level = 1;
+
+    if (options::kLevelCompactionDynamicLevelBytes) {
+        // 从最大一层的大小开始向上逐层缩小，直到不超过kMaxBytesForLevelBase且没有跳过有文件的层
+        uint64_t largest = 0;
+        int first_non_empty = last_level;
+        for (int level = last_level; level >= 1; --level) {
+            uint64_t bytes = LevelBytes(level);
+            if (bytes > largest) largest = bytes;
+            if (bytes > 0) first_non_empty = level;
+        }
+        *base_level = last_level;
+        base_bytes = largest;
+        while (*base_level > 1 && (base_bytes > options::kMaxBytesForLevelBase || *base_level > first_non_empty)) {
+            base_bytes /= options::kLevelSizeMultiplier;
+            --*base_level;
+        }
+        // 数据量很小时基础层的目标大小也不低于kMaxBytesForLevelBase / kLevelSizeMultiplier，避免频繁合并
+        base_bytes = std::max<uint64_t>(base_bytes, options::kMaxBytesForLevelBase / options::kLevelSizeMultiplier);
+    }
+
+    for (int level = *base_level; level <= last_level; ++level) {
+        max_bytes[level] = base_bytes;
+        base_bytes *= options::kLevelSizeMultiplier;
+    }
+    return max_bytes;
+}
+
+std::vector<KVStore::SortedRun> KVStore::SortedRuns() const {
+    std::vector<SortedRun> runs;
+    if (!sstable_meta_info_.empty()) {
+        // sstable_meta_info_[0]按时间戳从小到大排列，时间戳相同的文件属于同一个有序序列
+        for (auto iter = sstable_meta_info_[0].rbegin(); iter != sstable_meta_info_[0].rend(); ++iter) {
+            if (runs.empty() || runs.back().files.back().GetTimeStamp() != iter->GetTimeStamp()) {
+                runs.push_back(SortedRun{0, {}, 0});
+            }
+            runs.back().files.push_back(*iter);
+            runs.back().bytes += iter->GetFileSize();
+        }
+    }
+    for (int level = 1; level < (int)sstable_meta_info_.size(); ++level) {
+        if (sstable_meta_info_[level].empty()) continue;
+        runs.push_back(SortedRun{level, {}, LevelBytes(level)});
+        runs.back().files.assign(sstable_meta_info_[level].begin(), sstable_meta_info_[level].end());
+    }
+    return runs;
+}
+
+int KVStore::L0Pressure() const {
+    if (compaction_style_ == options::CompactionStyle::kUniversal) return SortedRuns().size();
+    return sstable_meta_info_.empty() ? 0 : sstable_meta_info_[0].size();
+}
+
+uint64_t KVStore::PendingCompactionBytes() const {
+    if (compaction_style_ == options::CompactionStyle::kUniversal) {
+        // 序列数达到触发值时，除最旧序列外的所有序列都要被重写
+        std::vector<SortedRun> runs = SortedRuns();
+        uint64_t bytes = 0;
+        if ((int)runs.size() >= options::kL0CompactionTrigger) {
+            for (size_t i = 0; i + 1 < runs.size(); ++i) {
+                bytes += runs[i].bytes;
+            }
+        }
+        return bytes;
+    }
+
+    // level0的文件全部要被重写；其他层超过目标大小的部分合并到下一层时，
+    // 还要重写下一层约kLevelSizeMultiplier倍的数据
+    uint64_t bytes = 0;
+    if (!sstable_meta_info_.empty() && (int)sstable_meta_info_[0].size() >= options::kL0CompactionTrigger) {
+        bytes += LevelBytes(0);
+    }
+    int base_level;
+    std::vector<uint64_t> max_bytes = LevelMaxBytes(&base_level);
+    for (int level = base_level; level + 1 < (int)max_bytes.size(); ++level) {
+        uint64_t level_bytes = LevelBytes(level);
+        if (level_bytes > max_bytes[level]) {
+            bytes += (level_bytes - max_bytes[level]) * (options::kLevelSizeMultiplier + 1);
+        }
+    }
+    return bytes;
+}
+
+void KVStore::TuneRateLimiter() {
+    if (options::kRateLimitBytesPerSec <= 0) return;
+    double ratio = std::min(1.0, (double)PendingCompactionBytes() / options::kRateLimitDebtForMaxBytes);
+    rate_limiter_.SetBytesPerSecond(options::kRateLimitBytesPerSec +
+        (int64_t)(ratio * (options::kRateLimitMaxBytesPerSec - options::kRateLimitBytesPerSec)));
+}
+
+void KVStore::MaybeScheduleCompaction() {
+    if (bg_error_) return;  // 写入失败后不再修改文件
+    TuneRateLimiter();
+    if (compaction_style_ == options::CompactionStyle::kUniversal) {
+        // 各任务的输入可能跨越所有层，同时只进行一个任务
+        if (bg_compactions_ == 0 && (int)SortedRuns().size() >= options::kL0CompactionTrigger) {
+            ++bg_compactions_;
+            compaction_pool_.Enqueue(&KVStore::BackgroundUniversalCompaction, this);
+        }
         return;
     }
 
-    // 判断当前层目录是否存在，不存在则创建目录
-    std::string path_level = dir_ + "/level" + std::to_string(level);
-    if (!utils::DirExists(path_level)) {
-        utils::MkDir(path_level.c_str());
-        level_num_vec_.emplace_back(0);
-        sstable_meta_info_.emplace_back();
+    int last_level = NumLevels() - 1;
+    compacting_levels_.resize(last_level + 1, false);
+    int base_level;
+    std::vector<uint64_t> max_bytes = LevelMaxBytes(&base_level);
+
+    // 按得分从大到小排序，待合并的层越多，提交的任务越多。最后一层不再向下合并
+    std::vector<std::tuple<double, int, int>> scores;   // 得分、输入层、输出层
+    if (!sstable_meta_info_.empty()) {
+        double score = (double)sstable_meta_info_[0].size() / options::kL0CompactionTrigger;
+        if (score >= 1) scores.emplace_back(score, 0, base_level);
     }
+    for (int level = base_level; level < last_level; ++level) {
+        double score = (double)LevelBytes(level) / max_bytes[level];
+        if (score > 1) scores.emplace_back(score, level, level + 1);
+    }
+    std::sort(scores.begin(), scores.end(), std::greater<>());
+
+    for (const auto &score : scores) {
+        if (bg_compactions_ >= options::kMaxBackgroundCompactions) break;
+        int input_level = std::get<1>(score);
+        int output_level = std::get<2>(score);
+        if (compacting_levels_[input_level] || compacting_levels_[output_level]) continue;
+        compacting_levels_[input_level] = true;
+        compacting_levels_[output_level] = true;
+        ++bg_compactions_;
+        compaction_pool_.Enqueue(&KVStore::BackgroundCompaction, this, input_level, output_level);
+    }
+}
+
+void KVStore::BackgroundCompaction(int input_level, int output_level) {
+    MajorCompaction(input_level, output_level);
+
+    std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    compacting_levels_[input_level] = false;
+    compacting_levels_[output_level] = false;
+    --bg_compactions_;
+    MaybeScheduleCompaction();  // 合并后output_level层可能超过目标大小
+    // 持有锁时通知，保证析构函数被唤醒时本任务已不再访问成员变量
+    bg_cv_.notify_all();
+}
 
-    // 判断是否到目前的最后一层，后续用于滤除最后一层中有删除标记的数据
-    bool last_level = false;
-    if (level == sstable_meta_info_.size() - 1) last_level = true;
+void KVStore::BackgroundUniversalCompaction() {
+    UniversalCompaction();
 
-    // 记录level-1层需要被删除的文件
-    std::vector<TableCache> file_to_rm_levelminus1;
-    // 记录level层需要被删除的文件
-    std::vector<TableCache> file_to_rm_level;
-    // 记录需要合并的所有文件  小顶堆
-    std::priority_queue<TableCache, std::vector<TableCache>, std::greater<>> sort_table_to_merge;
-    // 需要合并的文件数
-    int compact_num = (level - 1 == 0) ?
-        sst_num_for_levelminus1 :
-        (sst_num_for_levelminus1 - options::SSTMaxNumForLevel(level - 1));
+    std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+    --bg_compactions_;
+    MaybeScheduleCompaction();  // 合并期间flush可能生成了新的有序序列
+    // 持有锁时通知，保证析构函数被唤醒时本任务已不再访问成员变量
+    bg_cv_.notify_all();
+}
 
-    // 遍历level - 1层中将被合并的SST文件，获取时间戳和最小最大key
+void KVStore::UniversalCompaction() {
+    std::vector<std::vector<TableCache>> inputs;
+    int output_level;
     uint64_t time_stamp = 0;
-    int64_t temp_min = INT64_MAX, temp_max = INT64_MIN;
-    auto iter = sstable_meta_info_[level - 1].begin();
-    for (int i = 0; i < compact_num; ++i) {
-        TableCache table = *iter;
-        iter++;
+    bool last_level;
+
+    {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        std::vector<SortedRun> runs = SortedRuns();
+        size_t n = runs.size();
+        if ((int)n < options::kL0CompactionTrigger) return;
 
-        sort_table_to_merge.emplace(table);
-        file_to_rm_levelminus1.emplace_back(table);
+        // 选择从新到旧相邻的有序序列runs[start, end)
+        size_t start = 0, end = 0;
+        uint64_t newer_bytes = 0;
+        for (size_t i = 0; i + 1 < n; ++i) {
+            newer_bytes += runs[i].bytes;
+        }
+        if (newer_bytes * 100 > runs[n - 1].bytes * options::kUniversalMaxSizeAmplificationPercent) {
+            // 1. 空间放大过大，合并所有序列
+            end = n;
+        } else {
+            // 2. 从较新的序列开始，依次加入大小不超过已选序列总大小(100 + kUniversalSizeRatio)%的下一个序列
+            for (size_t i = 0; i < n && end == 0; ++i) {
+                uint64_t candidate_bytes = runs[i].bytes;
+                size_t j = i + 1;
+                while (j < n && candidate_bytes * (100 + options::kUniversalSizeRatio) >= runs[j].bytes * 100) {
+                    candidate_bytes += runs[j].bytes;
+                    ++j;
+                }
+                if (j - i >= (size_t)options::kUniversalMinMergeWidth) {
+                    start = i;
+                    end = j;
+                }
+            }
+            // 3. 没有大小相近的序列，合并最新的若干个序列，使序列数降到kL0CompactionTrigger以下
+            if (end == 0) {
+                end = n - options::kL0CompactionTrigger + 2;
+            }
+        }
 
-        time_stamp = table.GetTimeStamp();      // 时间戳应该用最小的还是最大的？
-        if (table.GetMinKey() < temp_min) temp_min = table.GetMinKey();
-        if (table.GetMaxKey() > temp_max) temp_max = table.GetMaxKey();
+        // 输出层：包含最旧的序列时为最后一层；最旧的被合并序列在level1及以上时为该层；
+        // 否则为下一个序列所在层的上一层，中间的层都是空的
+        if (end == n) {
+            output_level = NumLevels() - 1;
+        } else if (runs[end - 1].level > 0) {
+            output_level = runs[end - 1].level;
+        } else {
+            output_level = std::max(runs[end].level - 1, 0);
+        }
+        last_level = (end == n);
+
+        std::string path_level = dir_ + "/level" + std::to_string(output_level);
+        if (!utils::DirExists(path_level)) {
+            utils::MkDir(path_level.c_str());
+        }
+        if ((int)sstable_meta_info_.size() <= output_level) {
+            level_num_vec_.resize(output_level + 1, 0);
+            sstable_meta_info_.resize(output_level + 1);
+        }
+
+        // 输出文件的时间戳取被合并序列中最新的，level0中的输出文件仍然位于未被合并的序列之间
+        inputs.resize(sstable_meta_info_.size());
+        for (size_t i = start; i < end; ++i) {
+            std::vector<TableCache> &files = inputs[runs[i].level];
+            files.insert(files.end(), runs[i].files.begin(), runs[i].files.end());
+            for (const auto &table : runs[i].files) {
+                time_stamp = std::max(time_stamp, table.GetTimeStamp());
+            }
+        }
     }
 
-    // 找到level层与level-1层的key有交集的文件
-    for (auto& table : sstable_meta_info_[level]) {
-        if (table.GetMinKey() <= temp_max && table.GetMaxKey() >= temp_min) {
-            sort_table_to_merge.emplace(table);
-            file_to_rm_level.emplace_back(table);
+    CompactFiles(inputs, output_level, time_stamp, last_level);
+}
+
+void KVStore::MajorCompaction(int input_level, int output_level) {
+    // 记录input_level层需要被删除的文件
+    std::vector<TableCache> file_to_rm_input;
+    // 记录output_level层需要被删除的文件
+    std::vector<TableCache> file_to_rm_output;
+    // output_level下面是否没有数据，后续用于滤除最后一层中有删除标记的数据
+    bool last_level = true;
+    uint64_t time_stamp = 0;
+    int level = output_level;   // 输出层
+
+    // 选择输入文件。两层都已被标记，其他任务不会修改这两层的文件，也不会向更下面的层写入这些key
+    {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        if (sstable_meta_info_[input_level].empty()) return;
+
+        // 判断输出层目录是否存在，不存在则创建目录
+        std::string path_level = dir_ + "/level" + std::to_string(level);
+        if (!utils::DirExists(path_level)) {
+            utils::MkDir(path_level.c_str());
+        }
+        if ((int)sstable_meta_info_.size() <= level) {
+            level_num_vec_.resize(level + 1, 0);
+            sstable_meta_info_.resize(level + 1);
+        }
+        for (int i = level + 1; i < (int)sstable_meta_info_.size(); ++i) {
+            if (!sstable_meta_info_[i].empty()) last_level = false;
+        }
+
+        if (input_level == 0) {
+            // level0的文件key范围可能重叠，全部合并。时间戳取最新的文件
+            for (auto& table : sstable_meta_info_[0]) {
+                file_to_rm_input.emplace_back(table);
+                time_stamp = std::max(time_stamp, table.GetTimeStamp());
+            }
+        } else {
+            // 选择与下一层有交集的文件总大小相对自身大小最小的文件。level_files_中下一层的文件按key排列
+            static const std::vector<TableCache> kNoFiles;
+            static const std::vector<int64_t> kNoKeys;
+            const bool has_next = level < (int)level_files_.size();
+            const std::vector<TableCache> &next_files = has_next ? level_files_[level].files : kNoFiles;
+            const std::vector<int64_t> &next_max_keys = has_next ? level_files_[level].max_keys : kNoKeys;
+            const TableCache *best = nullptr;
+            double best_ratio = 0;
+            for (auto& table : sstable_meta_info_[input_level]) {
+                uint64_t overlap = 0;
+                size_t i = std::lower_bound(next_max_keys.begin(), next_max_keys.end(), table.GetMinKey()) -
+                           next_max_keys.begin();
+                for (; i < next_files.size() && next_files[i].GetMinKey() <= table.GetMaxKey(); ++i) {
+                    overlap += next_files[i].GetFileSize();
+                }
+                double ratio = (double)overlap / std::max<uint64_t>(table.GetFileSize(), 1);
+                if (best == nullptr || ratio < best_ratio) {
+                    best = &table;
+                    best_ratio = ratio;
+                }
+            }
+            file_to_rm_input.emplace_back(*best);
+            time_stamp = best->GetTimeStamp();
+        }
+
+        // 遍历被合并的文件，获取最小最大key
+        int64_t temp_min = INT64_MAX, temp_max = INT64_MIN;
+        for (auto& table : file_to_rm_input) {
+            if (table.GetMinKey() < temp_min) temp_min = table.GetMinKey();
+            if (table.GetMaxKey() > temp_max) temp_max = table.GetMaxKey();
+        }
+
+        // 找到输出层与被合并文件的key有交集的文件
+        for (auto& table : sstable_meta_info_[level]) {
+            if (table.GetMinKey() <= temp_max && table.GetMaxKey() >= temp_min) {
+                file_to_rm_output.emplace_back(table);
+            }
         }
     }
 
-    // 被合并的键值对，下标越大时间戳越大
-    std::vector<std::map<int64_t, std::string>> kv_to_compact;
-    // 被合并的键值对的迭代器
-    std::vector<std::map<int64_t, std::string>::iterator> kv_to_compact_iter;
-    // 各个SST文件中的最小键及其所在的SST文件的索引
-    std::map<int64_t, int> minkey_sstindex;
+    std::vector<std::vector<TableCache>> inputs(level + 1);
+    inputs[input_level] = std::move(file_to_rm_input);
+    inputs[level] = std::move(file_to_rm_output);
+    CompactFiles(inputs, level, time_stamp, last_level);
+}
 
-    // 从小顶堆中依次取出堆顶TableCache，并将其中的键值对全部读进内存，插入到vector中
-    while (!sort_table_to_merge.empty()) {
-        std::map<int64_t, std::string> kvpair;
-        sort_table_to_merge.top().Traverse(kvpair);
-        sort_table_to_merge.pop();
-        kv_to_compact.emplace_back(kvpair);     // 按照时间戳的顺序插入
+void KVStore::CompactFiles(const std::vector<std::vector<TableCache>> &inputs, int level, uint64_t time_stamp,
+                           bool last_level) {
+    std::vector<TableCache> input_files;
+    for (const auto &files : inputs) {
+        input_files.insert(input_files.end(), files.begin(), files.end());
     }
 
-    // 根据kv_to_compact的大小相应地调整kv_to_compact_iter的大小
-    kv_to_compact_iter.resize(kv_to_compact.size());
+    // 按输入文件的最小最大key把key范围切分成若干段，每段数据量约为一个SST文件以上时才切分。
+    // 第i段为[boundaries[i-1], boundaries[i])，同一个key的所有版本只会落在一段中
+    uint64_t input_bytes = 0;
+    int64_t input_min = INT64_MAX;
+    std::vector<int64_t> candidates;
+    for (auto& table : input_files) {
+        input_bytes += table.GetFileSize();
+        if (table.GetMinKey() < input_min) input_min = table.GetMinKey();
+        candidates.push_back(table.GetMinKey());
+        candidates.push_back(table.GetMaxKey());
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    candidates.erase(std::remove(candidates.begin(), candidates.end(), input_min), candidates.end());
+    size_t num_subcompactions = std::min<size_t>(options::kMaxSubcompactions, input_bytes / options::kMemTable);
+    num_subcompactions = std::max<size_t>(1, std::min(num_subcompactions, candidates.size() + 1));
+    std::vector<int64_t> boundaries;
+    for (size_t i = 1; i < num_subcompactions; ++i) {
+        boundaries.push_back(candidates[i * candidates.size() / num_subcompactions]);
+    }
+    boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
 
-    // 获取每个SST文件中的最小key，如果key相同则保留时间戳最大的（通过倒序遍历来实现）
-    for (int i = kv_to_compact.size() - 1; i >= 0; --i) {
-        auto iter = kv_to_compact[i].begin();
-        while (iter != kv_to_compact[i].end()) {
-            if (minkey_sstindex.count(iter->first) == 0) {
-                minkey_sstindex[iter->first] = i;
-                break;
+    // 比它新的版本的序列号不大于smallest_snapshot时，所有快照都看不到这个版本
+    SequenceNumber smallest_snapshot = SmallestSnapshot();
+    std::vector<Subcompaction> subcompactions(boundaries.size() + 1);
+    for (size_t i = 0; i < subcompactions.size(); ++i) {
+        Subcompaction &sub = subcompactions[i];
+        sub.level = level;
+        sub.time_stamp = time_stamp;
+        sub.last_level = last_level;
+        sub.smallest_snapshot = smallest_snapshot;
+        sub.start = (i == 0) ? INT64_MIN : boundaries[i - 1];
+        sub.has_end = i < boundaries.size();
+        sub.end = sub.has_end ? boundaries[i] : INT64_MAX;
+        for (auto& table : input_files) {
+            if (table.GetMaxKey() >= sub.start && (!sub.has_end || table.GetMinKey() < sub.end)) {
+                sub.inputs.push_back(table);
             }
-            iter++;
-        }
-        if (iter != kv_to_compact[i].end()) {
-            kv_to_compact_iter[i] = iter;
-        }
-    }
-
-    // SST文件大小（初始值为除了索引区和数据区之外的固定大小）
-    int size = options::kInitialSize;
-    // 暂存合并后的键值对
-    std::map<int64_t, std::string> new_table;
-    // 当前最小key及其对应的value和SST文件序号
-    int64_t temp_key;
-    std::string temp_value;
-    int index;
-
-    // 依次读取当前最小键值对，保存到new_table，若数据大小达到上限则写入文件
-    while (!minkey_sstindex.empty()) {
-        auto iter = minkey_sstindex.begin();
-        temp_key = iter->first;
-        index = iter->second;
-        temp_value = kv_to_compact[index][temp_key];
-        // temp_value = kv_to_compact_iter[index]->second;
-        if (!last_level || temp_value != options::kDelSign) {   // 有删除标记的不写入文件
-            size += strlen(temp_value.c_str()) + 1 + 12;           // 1: '\0', 12: key + offset的大小
-            if (size > options::kMemTable) {
-                WriteToFile(level, time_stamp, new_table.size(), new_table);
-                size = options::kInitialSize + strlen(temp_value.c_str()) + 1 + 12;
+        }
+    }
+
+    // 第一段在当前线程中归并，其余的提交到subcompaction_pool_并行执行
+    std::vector<std::future<void>> tasks;
+    for (size_t i = 1; i < subcompactions.size(); ++i) {
+        tasks.emplace_back(subcompaction_pool_.Enqueue(&KVStore::DoSubcompaction, this, &subcompactions[i]));
+    }
+    DoSubcompaction(&subcompactions[0]);
+    for (auto &task : tasks) task.get();
+
+    // 输出文件都写入成功并同步目录后才替换元信息、删除输入文件。否则删除已写完的输出文件，保留输入文件
+    bool ok = utils::SyncDir(dir_ + "/level" + std::to_string(level));
+    for (auto &sub : subcompactions) ok = ok && sub.ok;
+    if (!ok) {
+        for (auto &sub : subcompactions) {
+            for (auto &table : sub.outputs) {
+                file_cache_.Evict(table.GetFileName());
+                utils::RmFile(table.GetFileName().c_str());
             }
-            new_table[temp_key] = temp_value;
         }
-        minkey_sstindex.erase(temp_key);
-        kv_to_compact_iter[index]++;
-        Update(kv_to_compact, kv_to_compact_iter, minkey_sstindex, index);
+        bg_error_ = true;
+        return;
     }
 
-    // 剩下的数据也写入文件
-    if (!new_table.empty()) {
-        WriteToFile(level, time_stamp, new_table.size(), new_table);
+    // 一次性替换元信息。先移除被合并文件的元信息，新文件可能与输出层被合并的文件
+    // 有相同的时间戳和最小key，在std::set中会被当作同一个文件
+    {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        for (int i = 0; i < (int)inputs.size(); ++i) {
+            for (auto& table : inputs[i]) {
+                sstable_meta_info_[i].erase(table);
+            }
+        }
+        for (auto& sub : subcompactions) {
+            for (auto& table : sub.outputs) {
+                sstable_meta_info_[level].insert(std::move(table));
+            }
+        }
+        for (int i = 0; i < (int)inputs.size(); ++i) {
+            if (!inputs[i].empty() || i == level) RebuildLevelFiles(i);
+        }
     }
 
-    // 删除level-1和level层被合并的文件
-    for (auto& table : file_to_rm_levelminus1) {   // 没有修改level_num_vec_
+    // 删除被合并的文件，已打开或Pin了这些文件的迭代器不受影响
+    for (auto& table : input_files) {   // 没有修改level_num_vec_
+        file_cache_.Evict(table.GetFileName());
         utils::RmFile(table.GetFileName().c_str());
-        sstable_meta_info_[level - 1].erase(table);
     }
-    for (auto& table : file_to_rm_level) {
-        utils::RmFile(table.GetFileName().c_str());
-        sstable_meta_info_[level].erase(table);
+}
+
+void KVStore::DoSubcompaction(Subcompaction *sub) {
+    // 每个输入文件一个顺序读取器，用小顶堆按内部键多路归并。不同文件中的内部键不会重复，
+    // 同一个key的版本从新到旧依次输出。内存中只有每个输入文件正在读取的一批数据块，
+    // 不持有锁，输入文件仍然对读线程可见
+    std::vector<std::unique_ptr<TableScanner>> scanners;
+    for (auto& table : sub->inputs) {
+        scanners.emplace_back(new TableScanner(table));
+        scanners.back()->Seek(sub->start);
+    }
+    auto greater = [&scanners](size_t a, size_t b) { return scanners[b]->Key() < scanners[a]->Key(); };
+    std::vector<size_t> heap;
+    for (size_t i = 0; i < scanners.size(); ++i) {
+        if (scanners[i]->Valid()) heap.push_back(i);
     }
+    std::make_heap(heap.begin(), heap.end(), greater);
 
-    // 递归地判断下一层
-    MajorCompaction(level + 1);
+    SequenceNumber last_seq_for_key = kMaxSequenceNumber;
+    int64_t current_key = 0;
+    bool has_current_key = false;
+
+    // 正在写入的SST文件，第一次有数据写入时才创建
+    std::unique_ptr<TableBuilder> builder;
+    std::string file_name;
+
+    // 结束当前文件。写入失败时删除该文件并放弃整个子任务，由CompactFiles删除其余输出文件
+    auto finish_output = [&]() {
+        bool ok = builder->Finish();
+        builder.reset();
+        if (!ok) {
+            utils::RmFile(file_name.c_str());
+            sub->ok = false;
+            return false;
+        }
+        sub->outputs.emplace_back(file_name, &file_cache_, &block_cache_);
+        return true;
+    };
+
+    // 最后一层使用压缩率更高的算法
+    CompressionType compression = options::CompressionForLevel(sub->level, sub->last_level);
+
+    // 按内部键的顺序依次处理每个版本，直接写入SST文件。文件大小按压缩后估算，与各层大小的单位相同，
+    // 达到上限则结束当前文件
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), greater);
+        TableScanner &scanner = *scanners[heap.back()];
+        const InternalKey &ikey = scanner.Key();
+        if (sub->has_end && ikey.key >= sub->end) break;   // 之后的key属于下一段
+        bool first_version = !has_current_key || ikey.key != current_key;
+        if (first_version) {
+            current_key = ikey.key;
+            has_current_key = true;
+            last_seq_for_key = kMaxSequenceNumber;
+        }
+
+        bool drop = false;
+        if (last_seq_for_key <= sub->smallest_snapshot) {
+            drop = true;    // 被更新的版本覆盖，所有快照都看不到
+        } else if (sub->last_level && ikey.type == kTypeDeletion && ikey.seq <= sub->smallest_snapshot) {
+            drop = true;    // 最后一层中所有快照都能看到的删除标记，更旧的版本也会被丢弃
+        }
+        last_seq_for_key = ikey.seq;
+
+        if (!drop) {
+            // 只在key的第一个版本处切分文件，同一个key的所有版本都在同一个文件中
+            if (builder && first_version && builder->FileSize() >= (uint64_t)options::kMemTable &&
+                !finish_output()) {
+                return;
+            }
+            if (!builder) {
+                builder = NewTableBuilder(sub->level, sub->time_stamp, compression, &file_name);
+            }
+            builder->Add(ikey, scanner.Value());
+        }
+
+        scanner.Next();
+        if (scanner.Valid()) {
+            std::push_heap(heap.begin(), heap.end(), greater);
+        } else {
+            heap.pop_back();
+        }
+    }
+
+    // 结束最后一个文件
+    if (builder) finish_output();
 }
 
-void KVStore::WriteToFile(int level, uint64_t time_stamp, uint64_t num_pair,
-    std::map<int64_t, std::string>& new_table) {
+std::unique_ptr<TableBuilder> KVStore::NewTableBuilder(int level, uint64_t time_stamp, CompressionType compression,
+                                                       std::string *file_name) {
     std::string path = dir_ + "/level" + std::to_string(level);
-    level_num_vec_[level]++;
-    std::string file_name = path + "/SSTable" + std::to_string(level_num_vec_[level]) + ".sst";
-    std::fstream out_file(file_name, std::ios::app | std::ios::binary);
-
-    auto iter1 = new_table.begin();
-    int64_t min_key = iter1->first;
-    auto iter2 = new_table.rbegin();
-    int64_t max_key = iter2->first;
-
-    // 写入时间戳、键值对个数、最小键、最大键
-    out_file.write((char*)(&time_stamp), sizeof(uint64_t));
-    out_file.write((char*)(&num_pair), sizeof(uint64_t));
-    out_file.write((char*)(&min_key), sizeof(int64_t));
-    out_file.write((char*)(&max_key), sizeof(int64_t));
-
-    // 写入布隆过滤器
-    std::bitset<81920> filter;
-    int64_t temp_key;
-    const char* temp_value;
-    unsigned int hash[4] = { 0 };
-    while (iter1 != new_table.end()) {
-        temp_key = iter1->first;
-        MurmurHash3_x64_128(&temp_key, sizeof(temp_key), 1, hash);
-        for (auto i : hash) {
-            filter.set(i % 81920);
-        }
-        iter1++;
-    }
-    out_file.write((char*)(&filter), sizeof(filter));
-
-    // 写入索引区
-    const uint32_t val_start_area = options::kInitialSize + num_pair * 12; // 4 * 8  + 81920 / 8 + 索引区的长度
-    uint32_t index = 0;
-    iter1 = new_table.begin();
-    int offset = 0;
-    while (iter1 != new_table.end()) {
-        temp_key = iter1->first;
-        index = val_start_area + offset;
-        out_file.write((char*)(&temp_key), sizeof(int64_t));
-        out_file.write((char*)(&index), sizeof(uint32_t));
-        offset += strlen((iter1->second).c_str()) + 1;
-        iter1++;
-    }
-
-    // 写入数据区
-    iter1 = new_table.begin();
-    while (iter1 != new_table.end()) {
-        temp_value = (iter1->second).c_str();
-        out_file.write(temp_value, sizeof(char) * strlen((iter1->second).c_str()));
-        temp_value = "\0";
-        out_file.write(temp_value, sizeof(char) * 1);
-        iter1++;
-    }
-
-    out_file.close();
-
-    TableCache tc(file_name);
-    sstable_meta_info_[level].insert(std::move(tc));
-
-    new_table.clear();
+    int file_num;
+    {
+        std::unique_lock<std::shared_mutex> meta_lock(meta_mutex_);
+        file_num = ++level_num_vec_[level];
+    }
+    *file_name = path + "/SSTable" + std::to_string(file_num) + ".sst";
+    return std::unique_ptr<TableBuilder>(
+        new TableBuilder(*file_name, time_stamp, compression, &rate_limiter_, IoPriority::kLow));
 }
 
@@ -0,0 +1,102 @@
+#include "learned_index.h"
+
+#include <string.h>
+#include <algorithm>
+
+// 每个segment的字节数
+static const size_t kSegmentSize = 20;
+
+LearnedIndex::LearnedIndex(const std::string &contents) : error_(0) {
+    if (contents.size() < 2 * sizeof(uint32_t)) return;
+    uint32_t num;
+    memcpy(&error_, contents.data() + contents.size() - 8, sizeof(uint32_t));
+    memcpy(&num, contents.data() + contents.size() - 4, sizeof(uint32_t));
+    if (contents.size() != num * kSegmentSize + 2 * sizeof(uint32_t)) return;
+
+    segments_.resize(num);
+    const char *p = contents.data();
+    for (uint32_t i = 0; i < num; ++i, p += kSegmentSize) {
+        memcpy(&segments_[i].first_key, p, sizeof(int64_t));
+        memcpy(&segments_[i].slope, p + 8, sizeof(double));
+        memcpy(&segments_[i].base, p + 16, sizeof(uint32_t));
+    }
+}
+
+std::string LearnedIndex::Build(const std::vector<int64_t> &keys, uint32_t error) {
+    std::string result;
+    if (keys.empty()) return result;
+
+    // 每段从第一个点出发，维护能让已加入的所有点误差不超过error的斜率范围[lo, hi]，
+    // 新的点使范围为空时从它开始新的一段。斜率不小于0，保证预测值随key单调不减
+    uint32_t num = 0;
+    size_t start = 0;
+    double lo = 0, hi = 1e300;
+    auto emit = [&](size_t end) {
+        int64_t first_key = keys[start];
+        double slope = (end - start > 1 && hi < 1e300) ? (lo + hi) / 2 : 0;
+        uint32_t base = static_cast<uint32_t>(start);
+        result.append((char *)(&first_key), sizeof(int64_t));
+        result.append((char *)(&slope), sizeof(double));
+        result.append((char *)(&base), sizeof(uint32_t));
+        ++num;
+    };
+    for (size_t i = 1; i < keys.size(); ++i) {
+        // 用double计算差值，key相差很大时不会溢出
+        double dx = static_cast<double>(keys[i]) - static_cast<double>(keys[start]);
+        double dy = static_cast<double>(i - start);
+        bool fits;
+        if (dx <= 0) {
+            fits = dy <= error;    // 与第一个点的key相同，只能预测为base
+        } else {
+            double new_lo = std::max(lo, (dy - error) / dx);
+            double new_hi = std::min(hi, (dy + error) / dx);
+            fits = new_lo <= new_hi;
+            if (fits) {
+                lo = new_lo;
+                hi = new_hi;
+            }
+        }
+        if (!fits) {
+            emit(i);
+            start = i;
+            lo = 0;
+            hi = 1e300;
+        }
+    }
+    emit(keys.size());
+
+    result.append((char *)(&error), sizeof(uint32_t));
+    result.append((char *)(&num), sizeof(uint32_t));
+    return result;
+}
+
+void LearnedIndex::Predict(int64_t key, size_t n, size_t *lo, size_t *hi) const {
+    // 找到最后一个first_key不大于key的段，key比所有段都小时结果为0
+    if (segments_.empty() || key < segments_[0].first_key) {
+        *lo = *hi = 0;
+        return;
+    }
+    // 无分支的二分，base为最后一个first_key不大于key的段
+    const Segment *base = segments_.data();
+    size_t len = segments_.size();
+    while (len > 1) {
+        size_t half = len / 2;
+        base = (base[half].first_key <= key) ? base + half : base;
+        len -= half;
+    }
+    const Segment &segment = *base;
+    const Segment *next = base + 1;
+    // 预测值不超过下一段的起点，段内两点之间的key的结果在相邻两点的序号之间，误差再加1
+    double end = (next == segments_.data() + segments_.size()) ? static_cast<double>(n) : static_cast<double>(next->base);
+    double pos = segment.base + segment.slope * (static_cast<double>(key) - static_cast<double>(segment.first_key));
+    if (pos > end) pos = end;
+
+    // 结果与预测值相差不超过error_ + 1，在固定长度的窗口中查找，窗口超出数组时向内平移，
+    // 使查找的步数固定，没有分支预测失败
+    size_t width = 2 * static_cast<size_t>(error_) + 2;
+    size_t predicted = static_cast<size_t>(pos);
+    size_t first = (predicted > error_ + 1) ? predicted - error_ - 1 : 0;
+    if (first + width > n) first = (n > width) ? n - width : 0;
+    *lo = first;
+    *hi = (first + width > n) ? n : first + width;
+}
@@ -0,0 +1,118 @@
+#include "merging_iterator.h"
+
+#include <algorithm>
+
+MergingIterator::MergingIterator(std::vector<std::unique_ptr<InternalIterator>> children)
+    : children_(std::move(children)), current_(nullptr), current_index_(0), direction_(kForward) {
+    heap_.reserve(children_.size());
+}
+
+bool MergingIterator::Compare(size_t a, size_t b) const {
+    int64_t key_a = children_[a]->Key();
+    int64_t key_b = children_[b]->Key();
+    // key相同时下标小的(数据新的)排在堆顶
+    if (key_a == key_b) return a > b;
+    return (direction_ == kForward) ? (key_a > key_b) : (key_a < key_b);
+}
+
+void MergingIterator::RebuildHeap(Direction direction) {
+    direction_ = direction;
+    heap_.clear();
+    for (size_t i = 0; i < children_.size(); ++i) {
+        if (children_[i]->Valid()) heap_.push_back(i);
+    }
+    std::make_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return Compare(a, b); });
+    PopCurrent();
+}
+
+void MergingIterator::PopCurrent() {
+    if (heap_.empty()) {
+        current_ = nullptr;
+        return;
+    }
+    std::pop_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return Compare(a, b); });
+    current_index_ = heap_.back();
+    heap_.pop_back();
+    current_ = children_[current_index_].get();
+}
+
+void MergingIterator::AdvanceEqual() {
+    auto cmp = [this](size_t a, size_t b) { return Compare(a, b); };
+    int64_t key = current_->Key();
+
+    // 旧版本的同一个key一定紧跟在堆顶，逐个取出并移动
+    std::vector<size_t> moved{current_index_};
+    while (!heap_.empty() && children_[heap_.front()]->Key() == key) {
+        std::pop_heap(heap_.begin(), heap_.end(), cmp);
+        moved.push_back(heap_.back());
+        heap_.pop_back();
+    }
+
+    for (size_t i : moved) {
+        if (direction_ == kForward) {
+            children_[i]->Next();
+        } else {
+            children_[i]->Prev();
+        }
+        if (children_[i]->Valid()) {
+            heap_.push_back(i);
+            std::push_heap(heap_.begin(), heap_.end(), cmp);
+        }
+    }
+    PopCurrent();
+}
+
+void MergingIterator::SeekToFirst() {
+    for (auto &child : children_) child->SeekToFirst();
+    RebuildHeap(kForward);
+}
+
+void MergingIterator::SeekToLast() {
+    for (auto &child : children_) child->SeekToLast();
+    RebuildHeap(kReverse);
+}
+
+void MergingIterator::Seek(int64_t key) {
+    for (auto &child : children_) child->Seek(key);
+    RebuildHeap(kForward);
+}
+
+void MergingIterator::Next() {
+    if (direction_ != kForward) {
+        // 反向切换为正向：所有子迭代器定位到第一个大于key的位置
+        int64_t key = Key();
+        for (auto &child : children_) {
+            child->Seek(key);
+            if (child->Valid() && child->Key() == key) child->Next();
+        }
+        RebuildHeap(kForward);
+        return;
+    }
+    AdvanceEqual();
+}
+
+void MergingIterator::Prev() {
+    if (direction_ != kReverse) {
+        // 正向切换为反向：所有子迭代器定位到最后一个小于key的位置
+        int64_t key = Key();
+        for (auto &child : children_) {
+            child->Seek(key);
+            if (child->Valid()) {
+                child->Prev();
+            } else {
+                child->SeekToLast();
+            }
+        }
+        RebuildHeap(kReverse);
+        return;
+    }
+    AdvanceEqual();
+}
+
+void StoreIterator::SkipDeletedForward() {
+    while (iter_->Valid() && iter_->Type() == kTypeDeletion) iter_->Next();
+}
+
+void StoreIterator::SkipDeletedBackward() {
+    while (iter_->Valid() && iter_->Type() == kTypeDeletion) iter_->Prev();
+}
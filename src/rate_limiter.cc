@@ -0,0 +1,59 @@
+#include "rate_limiter.h"
+
+#include <algorithm>
+
+RateLimiter::RateLimiter(int64_t bytes_per_second, int64_t refill_period_us, int max_borrow_periods)
+    : bytes_per_second_(bytes_per_second), refill_period_us_(refill_period_us),
+      max_borrow_periods_(max_borrow_periods), available_(0), last_refill_(std::chrono::steady_clock::now()),
+      high_waiters_(0), total_bytes_{0, 0} {
+    available_ = std::max(PeriodBytes(), 0.0);
+}
+
+void RateLimiter::Refill() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_us = std::chrono::duration<double, std::micro>(now - last_refill_).count();
+    last_refill_ = now;
+    available_ = std::min(available_ + elapsed_us * bytes_per_second_ / 1000000, PeriodBytes());
+}
+
+void RateLimiter::Request(size_t bytes, IoPriority priority) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool high = (priority == IoPriority::kHigh);
+    total_bytes_[static_cast<int>(priority)] += bytes;
+    if (bytes_per_second_ <= 0) return;
+
+    if (high) ++high_waiters_;
+    while (bytes_per_second_ > 0) {
+        Refill();
+        // 高优先级请求可以透支到-floor，低优先级请求要等令牌数为正且没有高优先级请求在等待
+        double floor = high ? -PeriodBytes() * max_borrow_periods_ : 0;
+        if (available_ > floor && (high || high_waiters_ == 0)) break;
+
+        // 等到令牌补充到floor以上，最多等待一个补充周期后重新检查
+        double wait_us = (floor - available_ + 1) * 1000000 / bytes_per_second_;
+        wait_us = std::min<double>(std::max(wait_us, 1.0), refill_period_us_);
+        cv_.wait_for(lock, std::chrono::microseconds((int64_t)wait_us));
+    }
+    available_ -= bytes;
+    if (high) {
+        --high_waiters_;
+        cv_.notify_all();
+    }
+}
+
+void RateLimiter::SetBytesPerSecond(int64_t bytes_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Refill();
+    bytes_per_second_ = bytes_per_second;
+    cv_.notify_all();
+}
+
+int64_t RateLimiter::GetBytesPerSecond() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_per_second_;
+}
+
+uint64_t RateLimiter::GetTotalBytes(IoPriority priority) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_bytes_[static_cast<int>(priority)];
+}
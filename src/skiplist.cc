@@ -1,152 +1,225 @@
 #include "skiplist.h"
 
-SkipList::~SkipList() {
-    // std::cout << "SkipList::~SkipList()" << std::endl;
-
-    // 释放Node数据
-    Node *p = head_, *q = nullptr, *down = nullptr;
-    while (p != nullptr) {
-        down = p->down_;
-        while (p != nullptr) {
-            q = p->right_;
-            delete p;
-            p = q;
-        }
-        p = down;
+#include <random>
+#include <thread>
+
+#include "table_builder.h"
+
+SkipList::SkipList()
+    : size_(0),
+      max_height_(1),
+      time_stamp_(0),
+      min_key_(INT64_MAX),
+      max_key_(INT64_MIN) {
+    head_ = NewNode(INT64_MIN, kMaxSequenceNumber, kTypeValue, "", kMaxHeight);
+}
+
+Node *SkipList::NewNode(int64_t key, SequenceNumber seq, ValueType type, const std::string &val, int height) {
+    size_t node_size = sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1);
+    char *mem = arena_.AllocateAligned(node_size + sizeof(uint32_t) + val.size());
+    Node *node = reinterpret_cast<Node *>(mem);
+    node->key_ = key;
+    node->seq_ = seq;
+    node->type_ = type;
+    for (int i = 0; i < height; ++i) {
+        new (&node->next_[i]) std::atomic<Node *>(nullptr);
     }
 
-    // 重置成员变量
-    memory_ = options::kInitialSize; // 时间戳+元素个数+最小最大key+布隆过滤器所占的字节数
-    head_ = nullptr;
-    size_ = 0;
-    min_key_ = INT64_MAX;
-    max_key_ = INT64_MIN;
+    char *rep = mem + node_size;
+    uint32_t len = val.size();
+    memcpy(rep, &len, sizeof(uint32_t));
+    memcpy(rep + sizeof(uint32_t), val.data(), val.size());
+    node->val_ = rep;
+    return node;
 }
 
-std::string SkipList::Get(int64_t key) const {
-    if (size_ == 0) return "";
+int SkipList::RandomHeight() {
+    thread_local std::minstd_rand rnd(std::hash<std::thread::id>()(std::this_thread::get_id()));
+    int height = 1;
+    while (height < kMaxHeight && (rnd() % kBranching) == 0) {
+        ++height;
+    }
+    return height;
+}
 
-    Node *p = head_;
-    while (p != nullptr) {
-        while (p->right_ != nullptr && p->right_->key_ < key) {
-            p = p->right_;
+Node *SkipList::FindGreaterOrEqual(const InternalKey &ikey) const {
+    Node *x = head_;
+    int level = max_height_.load(std::memory_order_relaxed) - 1;
+    while (true) {
+        Node *next = x->Next(level);
+        if (next != nullptr && next->GetInternalKey() < ikey) {
+            x = next;       // 在当前层继续向右
+        } else {
+            if (level == 0) return next;
+            --level;        // 下降一层
         }
-        if (p->right_ != nullptr && p->right_->key_ == key) {
-            return (p->right_->val_);
-        }
-        p = p->down_;
     }
+}
 
-    return ""; // 找不到返回""
+Node *SkipList::FindLessThan(const InternalKey &ikey) const {
+    Node *x = head_;
+    int level = max_height_.load(std::memory_order_relaxed) - 1;
+    while (true) {
+        Node *next = x->Next(level);
+        if (next != nullptr && next->GetInternalKey() < ikey) {
+            x = next;
+        } else {
+            if (level == 0) return x;
+            --level;
+        }
+    }
 }
 
-void SkipList::Put(int64_t key, const std::string &val) {
-    // 更新最大最小key
-    if (key < min_key_)
-        min_key_ = key;
-    if (key > max_key_)
-        max_key_ = key;
+Node *SkipList::FindLast() const {
+    Node *x = head_;
+    int level = max_height_.load(std::memory_order_relaxed) - 1;
+    while (true) {
+        Node *next = x->Next(level);
+        if (next != nullptr) {
+            x = next;
+        } else {
+            if (level == 0) return x;
+            --level;
+        }
+    }
+}
 
-    std::vector<Node *> pre_node_list; // 记录每一层的前一节点
-    Node *p = head_;
-    while (p != nullptr) {
-        while (p->right_ != nullptr && p->right_->key_ <= key) {
-            p = p->right_;
+void SkipList::FindSpliceForLevel(const InternalKey &ikey, Node *before, int level, Node **prev, Node **next) const {
+    while (true) {
+        Node *after = before->Next(level);
+        if (after == nullptr || !(after->GetInternalKey() < ikey)) {
+            *prev = before;
+            *next = after;
+            return;
         }
-        pre_node_list.emplace_back(p);
-        p = p->down_;
+        before = after;
+    }
+}
+
+bool SkipList::Get(int64_t key, SequenceNumber seq, ValueType *type, std::string *val) const {
+    // 同一个key的版本从新到旧排列，第一个序列号不大于seq的就是可见的最新版本
+    Node *x = FindGreaterOrEqual(InternalKey{key, seq});
+    if (x != nullptr && x->key_ == key) {
+        *type = x->type_;
+        val->assign(x->val_ + sizeof(uint32_t), x->GetValLen());
+        return true;
     }
+    return false;
+}
 
-    // 存在相同的key：替换
-    if (!pre_node_list.empty() && pre_node_list.back()->key_ == key) {
-        while (!pre_node_list.empty() && pre_node_list.back()->key_ == key) {
-            Node *node = pre_node_list.back();
-            pre_node_list.pop_back();
-            node->val_ = val;
+void SkipList::Put(int64_t key, SequenceNumber seq, ValueType type, const std::string &val) {
+    InternalKey ikey{key, seq, type};
+    int height = RandomHeight();
+    int max_height = max_height_.load(std::memory_order_relaxed);
+    while (height > max_height) {
+        if (max_height_.compare_exchange_weak(max_height, height)) {
+            max_height = height;
+            break;
         }
-        return;
     }
 
-    // 不存在相同的key：插入
-    bool insert_up_flag = true;
-    Node *down_node = nullptr;
-    ++size_;
-    while (insert_up_flag && !pre_node_list.empty()) {
-        Node *insert_node = pre_node_list.back();
-        pre_node_list.pop_back();
-        insert_node->right_ = new Node(key, val, insert_node->right_, down_node);
-        down_node = insert_node->right_;
-        insert_up_flag = (rand() & 1); // 向上增加层数的概率为50%
+    // 自顶向下查找每一层的插入位置
+    Node *prev[kMaxHeight], *next[kMaxHeight];
+    Node *before = head_;
+    for (int i = max_height - 1; i >= 0; --i) {
+        FindSpliceForLevel(ikey, before, i, &prev[i], &next[i]);
+        before = prev[i];
     }
-    if (insert_up_flag) { // 如果pre_node_list空了但还要向上增加层数
-        Node *old_head = head_;
-        head_ = new Node();
-        head_->right_ = new Node(key, val, nullptr, down_node);
-        head_->down_ = old_head;
+
+    // 自底向上逐层用CAS链接新节点
+    Node *x = NewNode(key, seq, type, val, height);
+    for (int i = 0; i < height; ++i) {
+        while (true) {
+            x->NoBarrierSetNext(i, next[i]);
+            if (prev[i]->CASNext(i, next[i], x)) break;
+            // CAS失败说明有其它线程在prev[i]之后插入了节点，从prev[i]开始重新查找这一层
+            FindSpliceForLevel(ikey, prev[i], i, &prev[i], &next[i]);
+        }
     }
+
+    // 更新最大最小key和大小
+    int64_t cur = min_key_.load(std::memory_order_relaxed);
+    while (key < cur && !min_key_.compare_exchange_weak(cur, key)) {}
+    cur = max_key_.load(std::memory_order_relaxed);
+    while (key > cur && !max_key_.compare_exchange_weak(cur, key)) {}
+    ++size_;
 }
 
-// 写入时间戳、键值对个数、最小键、最大键、布隆过滤器、索引区、数据区
-void SkipList::Store(int num, const std::string &dir) {
+// 按内部键的顺序将需要保留的版本写入SST文件
+bool SkipList::Store(int num, const std::string &dir, uint64_t time_stamp, SequenceNumber smallest_snapshot,
+                     RateLimiter *rate_limiter) {
     std::string file_name = dir + "/SSTable" + std::to_string(num) + ".sst";
-    std::fstream out_file(file_name, std::ios::app | std::ios::binary);
-
-    Node *node = GetFirstNode()->right_;
-
-    ++time_stamp_; // TODO
-
-    // 写入时间戳、键值对个数、最小键、最大键
-    out_file.write((char *)(&time_stamp_), sizeof(uint64_t));
-    out_file.write((char *)(&size_), sizeof(uint64_t));
-    out_file.write((char *)(&min_key_), sizeof(int64_t));
-    out_file.write((char *)(&max_key_), sizeof(int64_t));
-
-    // 写入布隆过滤器
-    std::bitset<81920> filter;
-    int64_t temp_key;
-    const char *temp_value;
-    unsigned int hash[4] = {0};
-    while (node != nullptr) {
-        temp_key = node->key_;
-        MurmurHash3_x64_128(&temp_key, sizeof(temp_key), 1, hash);
-        for (auto i : hash) {
-            filter.set(i % 81920);
+    time_stamp_ = time_stamp;
+    TableBuilder builder(file_name, time_stamp, options::CompressionForLevel(0, false), rate_limiter,
+                         IoPriority::kHigh);
+
+    // 挑选需要写入的版本：每个key最新的版本，以及对某个快照可见的旧版本。
+    // 如果比它新的版本的序列号不大于smallest_snapshot，所有快照都看不到它
+    SequenceNumber last_seq_for_key = kMaxSequenceNumber;
+    int64_t last_key = 0;
+    bool has_last_key = false;
+    for (Node *node = GetFirstNode(); node != nullptr; node = node->Next(0)) {
+        if (!has_last_key || node->key_ != last_key) {
+            last_seq_for_key = kMaxSequenceNumber;  // key的第一个版本
+        }
+        if (last_seq_for_key > smallest_snapshot) {
+            builder.Add(node->GetInternalKey(), node->val_ + sizeof(uint32_t), node->GetValLen());
         }
-        node = node->right_;
+        last_key = node->key_;
+        has_last_key = true;
+        last_seq_for_key = node->seq_;
     }
-    out_file.write((char *)(&filter), sizeof(filter));
-
-    // 写入索引区
-    const uint32_t val_start_area = options::kInitialSize + size_ * 12; // 4 * 8  + 81920 / 8 + 索引区的长度
-    uint32_t index = 0;
-    node = GetFirstNode()->right_;
-    int offset = 0;
-    while (node != nullptr) {
-        temp_key = node->key_;
-        index = val_start_area + offset;
-        out_file.write((char *)(&temp_key), sizeof(int64_t));
-        out_file.write((char *)(&index), sizeof(uint32_t));
-        offset += strlen((node->val_).c_str()) + 1;
-        node = node->right_;
+
+    return builder.Finish();
+}
+
+Node *SkipList::GetFirstNode() const {
+    return head_->Next(0);
+}
+
+void MemTableIterator::FindNextVisible(Node *node) {
+    // 跳过序列号大于seq_的版本，同一个key的旧版本排在后面
+    while (node != nullptr && node->seq_ > seq_) {
+        node = node->Next(0);
     }
+    node_ = node;
+}
 
-    // 写入数据区
-    node = GetFirstNode()->right_;
-    while (node != nullptr) {
-        temp_value = (node->val_).c_str();
-        out_file.write(temp_value, sizeof(char) * strlen(node->val_.c_str()));
-        temp_value = "\0";
-        out_file.write(temp_value, sizeof(char) * 1);
-        node = node->right_;
+void MemTableIterator::FindPrevVisible(Node *node) {
+    while (node != table_->head_) {
+        // node是它的key最旧的版本，从头查找该key对seq_可见的最新版本
+        Node *visible = table_->FindGreaterOrEqual(InternalKey{node->key_, seq_});
+        if (visible != nullptr && visible->key_ == node->key_) {
+            node_ = visible;
+            return;
+        }
+        node = table_->FindLessThan(InternalKey{node->key_, kMaxSequenceNumber});
     }
+    node_ = nullptr;
+}
 
-    out_file.close();
+void MemTableIterator::SeekToFirst() {
+    FindNextVisible(table_->GetFirstNode());
 }
 
-Node *SkipList::GetFirstNode() const {
-    Node *p = head_;
-    while (p->down_ != nullptr) {
-        p = p->down_;
+void MemTableIterator::SeekToLast() {
+    FindPrevVisible(table_->FindLast());
+}
+
+void MemTableIterator::Seek(int64_t key) {
+    FindNextVisible(table_->FindGreaterOrEqual(InternalKey{key, seq_}));
+}
+
+void MemTableIterator::Next() {
+    // 跳过当前key的其余旧版本
+    Node *node = node_->Next(0);
+    while (node != nullptr && node->key_ == node_->key_) {
+        node = node->Next(0);
     }
-    return p;
-}
\ No newline at end of file
+    FindNextVisible(node);
+}
+
+void MemTableIterator::Prev() {
+    // 节点没有前驱指针，从头查找最后一个key小于当前key的节点
+    FindPrevVisible(table_->FindLessThan(InternalKey{node_->key_, kMaxSequenceNumber}));
+}
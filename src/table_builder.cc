@@ -0,0 +1,99 @@
+#include "table_builder.h"
+
+#include "learned_index.h"
+#include "options.h"
+
+TableBuilder::TableBuilder(const std::string &file_name, uint64_t time_stamp, CompressionType compression,
+                           RateLimiter *rate_limiter, IoPriority priority)
+    : file_(file_name, rate_limiter, priority), offset_(0),
+      time_stamp_(time_stamp), compression_(compression), num_pair_(0), min_key_(0), max_key_(0), max_seq_(0) {}
+
+void TableBuilder::Add(const InternalKey &ikey, const char *val, size_t len) {
+    if (num_pair_ == 0) min_key_ = ikey.key;
+    max_key_ = ikey.key;
+    if (ikey.seq > max_seq_) max_seq_ = ikey.seq;
+
+    // 同一个key的多个版本只需要在布隆过滤器中加入一次
+    if (num_pair_ == 0 || ikey.key != last_key_.key) {
+        filter_keys_.push_back(ikey.key);
+    }
+
+    block_.Add(ikey, val, len);
+    last_key_ = ikey;
+    ++num_pair_;
+
+    if (block_.CurrentSize() >= options::kBlockSize) {
+        FlushBlock();
+    }
+}
+
+void TableBuilder::FlushBlock() {
+    if (block_.Empty()) return;
+    const std::string &raw = block_.Finish();
+
+    // 压缩后至少减小1/2^kMinCompressionSavingShift才保存压缩后的内容
+    const std::string *contents = &raw;
+    CompressionType type = kNoCompression;
+    if (compression_ != kNoCompression && Compress(compression_, raw.data(), raw.size(), &compressed_) &&
+        compressed_.size() < raw.size() - (raw.size() >> options::kMinCompressionSavingShift)) {
+        contents = &compressed_;
+        type = compression_;
+    }
+
+    char trailer = static_cast<char>(type);
+    file_.Append(contents->data(), contents->size());
+    file_.Append(&trailer, kBlockTrailerSize);
+    uint32_t size = static_cast<uint32_t>(contents->size() + kBlockTrailerSize);
+    index_.push_back(BlockHandle{last_key_, static_cast<uint32_t>(offset_), size});
+    offset_ += size;
+    block_.Reset();
+}
+
+bool TableBuilder::Finish() {
+    FlushBlock();
+
+    // 写入布隆过滤器，大小与key的个数成正比
+    std::string filter = BloomFilter::Build(filter_keys_, options::kBloomBitsPerKey, options::kBlockedBloomFilter);
+    uint64_t filter_offset = offset_;
+    uint64_t filter_size = filter.size();
+    file_.Append(filter.data(), filter.size());
+    offset_ += filter.size();
+
+    // 写入学习索引
+    if (options::kLearnedIndex) {
+        std::vector<int64_t> last_keys;
+        last_keys.reserve(index_.size());
+        for (const BlockHandle &handle : index_) {
+            last_keys.push_back(handle.last_key.key);
+        }
+        std::string learned = LearnedIndex::Build(last_keys, options::kLearnedIndexError);
+        file_.Append(learned.data(), learned.size());
+        offset_ += learned.size();
+    }
+
+    // 写入索引区
+    uint64_t index_offset = offset_;
+    for (const BlockHandle &handle : index_) {
+        uint64_t tag = PackSequenceAndType(handle.last_key.seq, handle.last_key.type);
+        file_.Append((char *)(&handle.last_key.key), sizeof(int64_t));
+        file_.Append((char *)(&tag), sizeof(uint64_t));
+        file_.Append((char *)(&handle.offset), sizeof(uint32_t));
+        file_.Append((char *)(&handle.size), sizeof(uint32_t));
+    }
+
+    // 写入footer
+    uint64_t num_blocks = index_.size();
+    uint64_t magic = kTableMagicNumber;
+    file_.Append((char *)(&filter_offset), sizeof(uint64_t));
+    file_.Append((char *)(&filter_size), sizeof(uint64_t));
+    file_.Append((char *)(&index_offset), sizeof(uint64_t));
+    file_.Append((char *)(&num_blocks), sizeof(uint64_t));
+    file_.Append((char *)(&time_stamp_), sizeof(uint64_t));
+    file_.Append((char *)(&num_pair_), sizeof(uint64_t));
+    file_.Append((char *)(&min_key_), sizeof(int64_t));
+    file_.Append((char *)(&max_key_), sizeof(int64_t));
+    file_.Append((char *)(&max_seq_), sizeof(uint64_t));
+    file_.Append((char *)(&magic), sizeof(uint64_t));
+
+    return file_.Close();
+}
@@ -1,90 +1,420 @@
 #include "table_cache.h"
 
-TableCache::TableCache(const std::string &file_name) {
+#include <algorithm>
+#include <string.h>
+
+#include "options.h"
+
+TableCache::TableCache(const std::string &file_name, FileCache *file_cache, BlockCache *block_cache)
+    : time_and_size_{0, 0}, min_max_key_{0, 0}, file_size_(0), max_seq_(0),
+      bloom_filter_(std::make_shared<BloomFilter>()),
+      index_(std::make_shared<BlockIndex>()), file_cache_(file_cache),
+      block_cache_(block_cache), cache_id_(block_cache ? block_cache->NewId() : 0) {
     sst_path_ = file_name;
     Open();
 }
 
-std::string TableCache::GetValue(int64_t key) const {
+bool TableCache::GetValue(int64_t key, SequenceNumber seq, ValueType *type, std::string *val) const {
     // 判断是否在min_key~max_key之间
     if (key < min_max_key_[0] || key > min_max_key_[1]) {
-        return "";
+        return false;
     }
 
     // 利用布隆过滤器判断key是否存在，如果有一位为0则表示肯定不存在，如果都为1则表示可能存在
-    unsigned int hash[4] = {0};
-    MurmurHash3_x64_128(&key, sizeof(key), 1, hash);
-    for (auto i : hash) {
-        if (bloom_filter_[i % 81920] == 0) {
-            return "";
+    if (!bloom_filter_->KeyMayMatch(key)) {
+        return false;
+    }
+
+    // 在数据块索引中找到第一个可能包含该key可见版本的数据块，只读取这一个数据块。
+    // 同一个key的版本从新到旧排列，第一个序列号不大于seq的就是可见的最新版本
+    InternalKey target{key, seq};
+    size_t i = index_->LowerBound(target);
+    if (i == index_->Size()) return false;
+
+    std::shared_ptr<const Block> block = GetBlock(*OpenFile(), (*index_)[i], true);
+    InternalKey found;
+    if (!block->Seek(target, &found, val) || found.key != key) return false;
+
+    *type = found.type;
+    if (*type == kTypeDeletion) val->clear();
+    return true;
+}
+
+void TableCache::MultiGetValue(const int64_t *keys, size_t n, SequenceNumber seq, bool *found, ValueType *types,
+                               std::string *vals) const {
+    std::unique_ptr<bool[]> may_match(new bool[n]);
+    bloom_filter_->KeysMayMatch(keys, n, may_match.get());
+
+    // 找到每个key所在的数据块，key有序，所以相同的数据块相邻
+    std::vector<size_t> key_blocks(n, index_->Size());
+    std::vector<size_t> needed;     // 需要的数据块序号，不重复
+    for (size_t i = 0; i < n; ++i) {
+        found[i] = false;
+        if (keys[i] < min_max_key_[0] || keys[i] > min_max_key_[1] || !may_match[i]) continue;
+        key_blocks[i] = index_->LowerBound(InternalKey{keys[i], seq});
+        if (key_blocks[i] != index_->Size() && (needed.empty() || needed.back() != key_blocks[i])) {
+            needed.push_back(key_blocks[i]);
+        }
+    }
+    if (needed.empty()) return;
+
+    // 先查数据块缓存，未命中的数据块一起提交读请求
+    std::vector<std::shared_ptr<const Block>> blocks(needed.size());
+    std::vector<BlockHandle> misses;
+    std::vector<size_t> miss_slots;
+    for (size_t j = 0; j < needed.size(); ++j) {
+        const BlockHandle &handle = (*index_)[needed[j]];
+        if (block_cache_ != nullptr && (blocks[j] = block_cache_->Lookup(cache_id_, handle.offset)) != nullptr) {
+            continue;
         }
+        misses.push_back(handle);
+        miss_slots.push_back(j);
+    }
+    if (!misses.empty()) {
+        std::shared_ptr<RandomAccessFile> file = OpenFile();
+        for (size_t start = 0; start < misses.size(); start += options::kIoQueueDepth) {
+            size_t count = std::min<size_t>(options::kIoQueueDepth, misses.size() - start);
+            std::vector<Block> read = ReadBlocks(*file, &misses[start], count);
+            for (size_t k = 0; k < count; ++k) {
+                auto block = std::make_shared<const Block>(std::move(read[k]));
+                if (block_cache_ != nullptr && block->Size() > 0) {
+                    block_cache_->Insert(cache_id_, misses[start + k].offset, block);
+                }
+                blocks[miss_slots[start + k]] = std::move(block);
+            }
+        }
+    }
+
+    size_t j = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (key_blocks[i] == index_->Size()) continue;
+        while (needed[j] != key_blocks[i]) ++j;
+
+        InternalKey ikey;
+        if (!blocks[j]->Seek(InternalKey{keys[i], seq}, &ikey, &vals[i]) || ikey.key != keys[i]) continue;
+        found[i] = true;
+        types[i] = ikey.type;
+        if (types[i] == kTypeDeletion) vals[i].clear();
+    }
+}
+
+std::shared_ptr<RandomAccessFile> TableCache::OpenFile() const {
+    if (file_cache_ != nullptr) return file_cache_->Open(sst_path_);
+    return std::make_shared<RandomAccessFile>(sst_path_);
+}
+
+Block TableCache::ReadBlock(const RandomAccessFile &file, const BlockHandle &handle) {
+    std::string contents(handle.size, '\0');
+    if (!file.Read(handle.offset, handle.size, &contents[0])) contents.clear();
+    return DecodeBlock(std::move(contents));
+}
+
+std::vector<Block> TableCache::ReadBlocks(const RandomAccessFile &file, const BlockHandle *handles, size_t n) {
+    std::vector<Block> blocks;
+    blocks.reserve(n);
+    for (std::string &contents : ReadRawBlocks(file, handles, n)) {
+        blocks.push_back(DecodeBlock(std::move(contents)));
     }
+    return blocks;
+}
+
+std::vector<std::string> TableCache::ReadRawBlocks(const RandomAccessFile &file, const BlockHandle *handles,
+                                                   size_t n) {
+    std::vector<std::string> contents(n);
+    std::vector<ReadRequest> reqs(n);
+    for (size_t i = 0; i < n; ++i) {
+        contents[i].resize(handles[i].size);
+        reqs[i] = ReadRequest{-1, handles[i].offset, handles[i].size, &contents[i][0], false};
+    }
+    file.ReadBatch(reqs.data(), n);
 
-    // 在索引区查找，如果存在该key则需要先获取value的长度再读取value
-    auto iter1 = key_offset_map_.find(key);
-    if (iter1 == key_offset_map_.end()) return "";
-    auto iter2 = iter1;
-    ++iter2;
-    std::fstream file(sst_path_, std::ios::in | std::ios::binary);
-    file.seekg(0, std::ios::end);   // 移动到文件末尾
-    uint64_t len = (iter2 != key_offset_map_.end())
-                                 ? (iter2->second - iter1->second)  // 如果key不是最后一个，则两个偏移量相减
-                                 : ((int)file.tellg() - iter1->second);   // 如果key是最后一个，则文件末尾位置减偏移量
-    file.seekg(iter1->second);      // 移动到key对应的value所在位置
-    std::string value(len - 1, ' ');
-    file.read(&(*value.begin()), sizeof(char) * len);
+    for (size_t i = 0; i < n; ++i) {
+        if (!reqs[i].ok) contents[i].clear();
+    }
+    return contents;
+}
 
-    file.close();
+Block TableCache::DecodeBlock(std::string contents) {
+    std::string raw;
+    if (contents.size() < kBlockTrailerSize) return Block(std::move(raw));
+    // 去掉末尾的压缩类型后解压，读取失败或数据损坏时返回空的数据块
+    CompressionType type = static_cast<CompressionType>(contents.back());
+    contents.pop_back();
+    if (type == kNoCompression) return Block(std::move(contents));
+    if (!Uncompress(type, contents.data(), contents.size(), &raw)) raw.clear();
+    return Block(std::move(raw));
+}
 
-    return value;
+std::shared_ptr<const Block> TableCache::GetBlock(const RandomAccessFile &file, const BlockHandle &handle,
+                                                bool fill_cache) const {
+    std::shared_ptr<const Block> block;
+    if (block_cache_ != nullptr && (block = block_cache_->Lookup(cache_id_, handle.offset)) != nullptr) {
+        return block;
+    }
+    block = std::make_shared<const Block>(ReadBlock(file, handle));
+    if (block_cache_ != nullptr && fill_cache && block->Size() > 0) {
+        block_cache_->Insert(cache_id_, handle.offset, block);
+    }
+    return block;
 }
 
 void TableCache::Open() {
-    std::fstream file(sst_path_, std::ios::in | std::ios::binary);
-
-    if (file.is_open()) {
-        file.read((char *)&time_and_size_, 2 * sizeof(uint64_t));
-        file.read((char *)&min_max_key_, 2 * sizeof(int64_t));
-        file.read((char *)&bloom_filter_, sizeof(bloom_filter_));
-
-        uint64_t size = time_and_size_[1];
-        int64_t temp_key;
-        uint32_t temp_offset;
-        while (size--) {
-            file.read((char *)&temp_key, sizeof(int64_t));
-            file.read((char *)&temp_offset, sizeof(uint32_t));
-            key_offset_map_[temp_key] = temp_offset;
-        }
+    std::shared_ptr<RandomAccessFile> file = OpenFile();
+    file_size_ = file->Size();
+    if (!file->IsOpen() || file_size_ < kFooterSize) return;
+
+    // 读取footer
+    char footer[kFooterSize];
+    uint64_t filter_offset, filter_size, index_offset, num_blocks, magic;
+    bool ok = file->Read(file_size_ - kFooterSize, kFooterSize, footer);
+    memcpy(&filter_offset, footer, sizeof(uint64_t));
+    memcpy(&filter_size, footer + 8, sizeof(uint64_t));
+    memcpy(&index_offset, footer + 16, sizeof(uint64_t));
+    memcpy(&num_blocks, footer + 24, sizeof(uint64_t));
+    memcpy(&time_and_size_, footer + 32, 2 * sizeof(uint64_t));
+    memcpy(&min_max_key_, footer + 48, 2 * sizeof(int64_t));
+    memcpy(&max_seq_, footer + 64, sizeof(uint64_t));
+    memcpy(&magic, footer + 72, sizeof(uint64_t));
+    std::string filter(ok ? filter_size : 0, '\0');
+    if (!ok || magic != kTableMagicNumber || filter_offset + filter_size > index_offset ||
+        index_offset + num_blocks * kBlockIndexEntrySize + kFooterSize != file_size_ ||
+        !file->Read(filter_offset, filter_size, &filter[0])) {
+        time_and_size_[0] = time_and_size_[1] = 0;
+        min_max_key_[0] = min_max_key_[1] = 0;
+        max_seq_ = 0;
+        return;
+    }
+    bloom_filter_ = std::make_shared<BloomFilter>(std::move(filter));
+
+    // 布隆过滤器和索引区之间是学习索引，没有学习索引时为空
+    std::string learned(index_offset - filter_offset - filter_size, '\0');
+    if (!learned.empty() && !file->Read(filter_offset + filter_size, learned.size(), &learned[0])) learned.clear();
 
-        file.close();
+    // 一次读入整个数据块索引再解析
+    std::string index(num_blocks * kBlockIndexEntrySize, '\0');
+    if (!file->Read(index_offset, index.size(), &index[0])) return;
+    std::vector<BlockHandle> handles;
+    handles.reserve(num_blocks);
+    const char *p = index.data();
+    uint64_t tag;
+    BlockHandle handle;
+    for (uint64_t i = 0; i < num_blocks; ++i, p += kBlockIndexEntrySize) {
+        memcpy(&handle.last_key.key, p, sizeof(int64_t));
+        memcpy(&tag, p + 8, sizeof(uint64_t));
+        memcpy(&handle.offset, p + 16, sizeof(uint32_t));
+        memcpy(&handle.size, p + 20, sizeof(uint32_t));
+        handle.last_key.seq = tag >> 8;
+        handle.last_key.type = static_cast<ValueType>(tag & 0xff);
+        handles.push_back(handle);
     }
+    index_ = std::make_shared<BlockIndex>(std::move(handles), learned);
 }
 
-void TableCache::Traverse(std::map<int64_t, std::string> &pair) const {
-    std::fstream file(sst_path_, std::ios::in | std::ios::binary);
-    auto iter1 = key_offset_map_.begin();
-    auto iter2 = iter1;
-    iter2++;
-    uint64_t len = 0;
+TableScanner::TableScanner(const TableCache &table)
+    : table_(table), index_(table.index_), next_read_(0), batch_pos_(0), pos_(0) {}
 
-    // 循环读取key对应的value
-    while (iter1 != key_offset_map_.end()) {
-        // 获取value的长度
-        if (iter2 != key_offset_map_.end()) {
-            len = iter2->second - iter1->second;
-            iter2++;
-        } else {
-            file.seekg(0, std::ios::end);
-            len = (int)file.tellg() - iter1->second;
+void TableScanner::Next() {
+    if (++pos_ == entries_.size()) {
+        LoadNextBlock();
+    }
+}
+
+void TableScanner::Seek(int64_t key) {
+    SeekToBlock(index_->LowerBound(InternalKey{key, kMaxSequenceNumber}));
+    while (Valid() && Key().key < key) {
+        Next();
+    }
+}
+
+void TableScanner::SeekToBlock(size_t i) {
+    if (file_ == nullptr) file_ = table_.OpenFile();
+    next_read_ = i;
+    batch_.clear();
+    batch_pos_ = 0;
+    LoadNextBlock();
+}
+
+void TableScanner::LoadNextBlock() {
+    entries_.clear();
+    pos_ = 0;
+    while (entries_.empty()) {
+        if (batch_pos_ == batch_.size()) {
+            if (next_read_ >= index_->Size()) return;
+            // 在字节预算内尽量多读，至少读取一个数据块
+            size_t n = 0;
+            size_t bytes = 0;
+            while (next_read_ + n < index_->Size() && n < (size_t)options::kIoQueueDepth) {
+                bytes += (*index_)[next_read_ + n].size;
+                if (n > 0 && bytes > options::kCompactionReadaheadSize) break;
+                ++n;
+            }
+            batch_ = TableCache::ReadRawBlocks(*file_, &(*index_)[next_read_], n);
+            next_read_ += n;
+            batch_pos_ = 0;
         }
+        // 解压后立即释放原始内容
+        TableCache::DecodeBlock(std::move(batch_[batch_pos_++])).DecodeAll(&entries_);
+    }
+}
+
+TableIterator::TableIterator(const TableCache &table, SequenceNumber seq, bool fill_cache)
+    : table_(table), seq_(seq), fill_cache_(fill_cache), index_(table.index_), block_index_(table.index_->Size()),
+      loaded_block_(SIZE_MAX), pos_(0), file_(table.OpenFile()) {}
+
+void TableIterator::LoadBlock(size_t i) {
+    block_index_ = i;
+    pos_ = 0;
+    if (i >= index_->Size() || i == loaded_block_) return;
 
-        // 读取value
-        file.seekg(iter1->second);
-        std::string value(len, ' ');
-        file.read(&(*value.begin()), sizeof(char) * len);
-        pair[iter1->first] = value;
-        iter1++;
+    entries_.clear();
+    table_.GetBlock(*file_, (*index_)[i], fill_cache_)->DecodeAll(&entries_);
+    loaded_block_ = i;
+    if (entries_.empty()) block_index_ = index_->Size();   // 读取失败，迭代器变为无效
+}
+
+void TableIterator::RawSeek(const InternalKey &target) {
+    LoadBlock(index_->LowerBound(target));
+    if (!Valid()) return;
+    auto iter = std::lower_bound(entries_.begin(), entries_.end(), target,
+        [](const std::pair<InternalKey, std::string> &entry, const InternalKey &t) { return entry.first < t; });
+    pos_ = iter - entries_.begin();
+}
+
+void TableIterator::RawNext() {
+    if (++pos_ == entries_.size()) {
+        LoadBlock(block_index_ + 1);
+    }
+}
+
+void TableIterator::RawPrev() {
+    if (Valid() && pos_ > 0) {
+        --pos_;
+        return;
+    }
+    // 位于数据块的第一条记录，或位于最后一条记录之后
+    LoadBlock(Valid() ? block_index_ - 1 : index_->Size() - 1);
+    if (Valid()) pos_ = entries_.size() - 1;
+}
+
+void TableIterator::FindNextVisible() {
+    // 跳过序列号大于seq_的版本，同一个key的旧版本排在后面
+    while (Valid() && entries_[pos_].first.seq > seq_) {
+        RawNext();
+    }
+}
+
+void TableIterator::FindPrevVisible() {
+    while (!AtFirst()) {
+        // 前一项是它的key最旧的版本，查找该key对seq_可见的最新版本
+        RawPrev();
+        int64_t key = Key();
+        RawSeek(InternalKey{key, seq_});
+        if (Valid() && Key() == key) return;
+        RawSeek(InternalKey{key, kMaxSequenceNumber});
+    }
+    LoadBlock(index_->Size());  // 已经是第一个key，迭代器变为无效
+}
+
+void TableIterator::SeekToFirst() {
+    LoadBlock(0);
+    FindNextVisible();
+}
+
+void TableIterator::SeekToLast() {
+    LoadBlock(index_->Size());
+    FindPrevVisible();
+}
+
+void TableIterator::Seek(int64_t key) {
+    RawSeek(InternalKey{key, seq_});
+    FindNextVisible();
+}
+
+void TableIterator::Next() {
+    // 跳过当前key的其余旧版本
+    int64_t key = Key();
+    do {
+        RawNext();
+    } while (Valid() && Key() == key);
+    FindNextVisible();
+}
+
+void TableIterator::Prev() {
+    RawSeek(InternalKey{Key(), kMaxSequenceNumber});
+    FindPrevVisible();
+}
+
+LevelIterator::LevelIterator(std::vector<TableCache> files, std::vector<int64_t> max_keys, SequenceNumber seq,
+                             bool fill_cache)
+    : files_(std::move(files)), max_keys_(std::move(max_keys)), seq_(seq), fill_cache_(fill_cache),
+      file_index_(files_.size()) {
+    for (const TableCache &table : files_) {
+        if (table.file_cache_ != nullptr) table.file_cache_->Pin(table.GetFileName());
+    }
+}
+
+LevelIterator::~LevelIterator() {
+    iter_.reset();
+    for (const TableCache &table : files_) {
+        if (table.file_cache_ != nullptr) table.file_cache_->Unpin(table.GetFileName());
+    }
+}
+
+void LevelIterator::OpenTable(size_t i) {
+    if (i >= files_.size()) {
+        iter_.reset();
+        file_index_ = files_.size();
+        return;
+    }
+    if (i == file_index_ && iter_ != nullptr) return;
+    iter_.reset(new TableIterator(files_[i], seq_, fill_cache_));
+    file_index_ = i;
+}
+
+void LevelIterator::SkipEmptyTablesForward() {
+    while (iter_ != nullptr && !iter_->Valid()) {
+        OpenTable(file_index_ + 1);
+        if (iter_ != nullptr) iter_->SeekToFirst();
+    }
+}
+
+void LevelIterator::SkipEmptyTablesBackward() {
+    while (iter_ != nullptr && !iter_->Valid()) {
+        if (file_index_ == 0) {
+            OpenTable(files_.size());
+            return;
+        }
+        OpenTable(file_index_ - 1);
+        iter_->SeekToLast();
     }
+}
+
+void LevelIterator::SeekToFirst() {
+    OpenTable(0);
+    if (iter_ != nullptr) iter_->SeekToFirst();
+    SkipEmptyTablesForward();
+}
+
+void LevelIterator::SeekToLast() {
+    if (files_.empty()) return;
+    OpenTable(files_.size() - 1);
+    iter_->SeekToLast();
+    SkipEmptyTablesBackward();
+}
+
+void LevelIterator::Seek(int64_t key) {
+    // 第一个最大key不小于key的文件
+    OpenTable(std::lower_bound(max_keys_.begin(), max_keys_.end(), key) - max_keys_.begin());
+    if (iter_ != nullptr) iter_->Seek(key);
+    SkipEmptyTablesForward();
+}
+
+void LevelIterator::Next() {
+    iter_->Next();
+    SkipEmptyTablesForward();
+}
 
-    file.close();
+void LevelIterator::Prev() {
+    iter_->Prev();
+    SkipEmptyTablesBackward();
 }
@@ -0,0 +1,176 @@
+#include "wal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <chrono>
+
+#include "murmurhash3.h"
+
+namespace wal {
+
+void EncodeRecord(std::string *dst, RecordType type, int64_t key, const std::string &val) {
+    uint32_t val_len = val.size();
+    dst->push_back(static_cast<char>(type));
+    dst->append((const char *)&key, sizeof(int64_t));
+    dst->append((const char *)&val_len, sizeof(uint32_t));
+    dst->append(val);
+}
+
+bool DecodeRecord(const std::string &payload, size_t *pos, RecordType *type, int64_t *key, std::string *val) {
+    const size_t fixed_len = 1 + sizeof(int64_t) + sizeof(uint32_t);
+    if (*pos + fixed_len > payload.size()) return false;
+
+    const char *p = payload.data() + *pos;
+    uint32_t val_len;
+    *type = static_cast<RecordType>(p[0]);
+    memcpy(key, p + 1, sizeof(int64_t));
+    memcpy(&val_len, p + 1 + sizeof(int64_t), sizeof(uint32_t));
+    if (*pos + fixed_len + val_len > payload.size()) return false;
+
+    val->assign(p + fixed_len, val_len);
+    *pos += fixed_len + val_len;
+    return true;
+}
+
+bool DecodeRecordKey(const std::string &payload, size_t *pos, int64_t *key) {
+    const size_t fixed_len = 1 + sizeof(int64_t) + sizeof(uint32_t);
+    if (*pos + fixed_len > payload.size()) return false;
+
+    const char *p = payload.data() + *pos;
+    uint32_t val_len;
+    memcpy(key, p + 1, sizeof(int64_t));
+    memcpy(&val_len, p + 1 + sizeof(int64_t), sizeof(uint32_t));
+    if (*pos + fixed_len + val_len > payload.size()) return false;
+
+    *pos += fixed_len + val_len;
+    return true;
+}
+
+// 计算payload的校验和
+static uint32_t Checksum(const char *data, size_t len) {
+    uint32_t crc = 0;
+    MurmurHash3_x86_32(data, len, 0x4c534d, &crc);
+    return crc;
+}
+
+}   // namespace wal
+
+/**
+ * @brief 写满buf中的所有数据，处理部分写和EINTR
+ */
+static bool WriteAll(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * @brief 读满len字节，返回实际读到的字节数
+ */
+static size_t ReadAll(int fd, char *buf, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = ::read(fd, buf + total, len - total);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        total += n;
+    }
+    return total;
+}
+
+WalWriter::WalWriter(const std::string &file_name, options::WalSyncMode mode)
+    : file_name_(file_name), mode_(mode), dirty_(false), stop_(false) {
+    fd_ = ::open(file_name_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (mode_ == options::WalSyncMode::kSyncInterval) {
+        sync_thread_ = std::thread(&WalWriter::BackgroundSync, this);
+    }
+}
+
+WalWriter::~WalWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_one();
+    if (sync_thread_.joinable()) sync_thread_.join();
+
+    if (fd_ >= 0) {
+        if (mode_ != options::WalSyncMode::kNoSync) ::fdatasync(fd_);
+        ::close(fd_);
+    }
+}
+
+bool WalWriter::AddRecord(const std::string &payload) {
+    if (fd_ < 0) return false;
+
+    // 头部和payload拼在一起，只调用一次write
+    std::string record;
+    record.reserve(wal::kHeaderSize + payload.size());
+    uint32_t crc = wal::Checksum(payload.data(), payload.size());
+    uint32_t len = payload.size();
+    record.append((const char *)&crc, sizeof(uint32_t));
+    record.append((const char *)&len, sizeof(uint32_t));
+    record.append(payload);
+
+    if (!WriteAll(fd_, record.data(), record.size())) return false;
+
+    if (mode_ == options::WalSyncMode::kSyncEveryWrite) {
+        return ::fdatasync(fd_) == 0;
+    }
+    if (mode_ == options::WalSyncMode::kSyncInterval) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        dirty_ = true;
+    }
+    return true;
+}
+
+bool WalWriter::Sync() {
+    if (fd_ < 0) return false;
+    return ::fdatasync(fd_) == 0;
+}
+
+void WalWriter::BackgroundSync() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        cond_.wait_for(lock, std::chrono::milliseconds(options::kWalSyncIntervalMs), [this] { return stop_; });
+        if (dirty_) {
+            dirty_ = false;
+            lock.unlock();
+            ::fdatasync(fd_);
+            lock.lock();
+        }
+    }
+}
+
+WalReader::WalReader(const std::string &file_name) {
+    fd_ = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+WalReader::~WalReader() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool WalReader::ReadRecord(std::string *payload) {
+    if (fd_ < 0) return false;
+
+    char header[wal::kHeaderSize];
+    if (ReadAll(fd_, header, wal::kHeaderSize) != wal::kHeaderSize) return false;
+
+    uint32_t crc, len;
+    memcpy(&crc, header, sizeof(uint32_t));
+    memcpy(&len, header + sizeof(uint32_t), sizeof(uint32_t));
+
+    payload->resize(len);
+    if (ReadAll(fd_, &(*payload)[0], len) != len) return false;
+
+    return wal::Checksum(payload->data(), payload->size()) == crc;
+}
@@ -0,0 +1,16 @@
+#include "write_batch.h"
+
+void WriteBatch::Put(int64_t key, const std::string &val) {
+    wal::EncodeRecord(&rep_, wal::kTypeValue, key, val);
+    ++count_;
+}
+
+void WriteBatch::Del(int64_t key) {
+    wal::EncodeRecord(&rep_, wal::kTypeDeletion, key, "");
+    ++count_;
+}
+
+void WriteBatch::Clear() {
+    rep_.clear();
+    count_ = 0;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "block_index.h"
+#include "options.h"
+
+// 比较几种内存索引的点查询耗时和内存占用：
+// 1. std::map<int64_t, uint32_t>：每个key一个红黑树节点
+// 2. 有序数组上的std::lower_bound
+// 3. BlockIndex的Eytzinger数组
+// 4. BlockIndex的学习索引
+// 每个索引项对应一个key，查询的key均匀随机地取自已有的key，查找后读取对应数据块的偏移量
+
+// std::map每个节点的大约字节数：红黑树的3个指针和颜色，加上key和value
+static const size_t kMapNodeSize = 4 * sizeof(void *) + sizeof(std::pair<const int64_t, uint32_t>);
+
+static volatile size_t sink;
+
+template <typename Func>
+static double MeasureNs(const std::vector<int64_t> &queries, Func lookup) {
+    size_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int64_t key : queries) sum += lookup(key);
+    auto end = std::chrono::steady_clock::now();
+    sink = sum;
+    return std::chrono::duration<double, std::nano>(end - start).count() / queries.size();
+}
+
+static void Run(const std::string &name, const std::vector<int64_t> &keys, size_t num_queries) {
+    std::mt19937_64 rng(7);
+    std::vector<int64_t> queries(num_queries);
+    for (int64_t &q : queries) q = keys[rng() % keys.size()];
+
+    std::map<int64_t, uint32_t> map;
+    std::vector<BlockHandle> handles;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        map[keys[i]] = static_cast<uint32_t>(i);
+        handles.push_back(BlockHandle{InternalKey{keys[i], 1, kTypeValue}, static_cast<uint32_t>(i), 1});
+    }
+    std::string learned = LearnedIndex::Build(keys, options::kLearnedIndexError);
+    BlockIndex eytzinger(handles);
+    BlockIndex learned_index(handles, learned);
+    size_t handles_size = handles.size() * sizeof(BlockHandle);
+
+    double map_ns = MeasureNs(queries, [&](int64_t key) { return map.lower_bound(key)->second; });
+    double array_ns = MeasureNs(queries, [&](int64_t key) {
+        return handles[std::lower_bound(keys.begin(), keys.end(), key) - keys.begin()].offset;
+    });
+    double eytzinger_ns = MeasureNs(queries, [&](int64_t key) { return eytzinger[eytzinger.LowerBound(key)].offset; });
+    double learned_ns = MeasureNs(queries, [&](int64_t key) { return learned_index[learned_index.LowerBound(key)].offset; });
+
+    std::cout << name << " (" << keys.size() << " keys, " << LearnedIndex(learned).NumSegments() << " segments)\n"
+              << std::fixed << std::setprecision(1)
+              << "  std::map         " << std::setw(8) << map_ns << " ns  " << std::setw(10)
+              << map.size() * kMapNodeSize << " B\n"
+              << "  sorted array     " << std::setw(8) << array_ns << " ns  " << std::setw(10)
+              << keys.size() * sizeof(int64_t) << " B\n"
+              << "  eytzinger        " << std::setw(8) << eytzinger_ns << " ns  " << std::setw(10)
+              << eytzinger.MemoryUsage() - handles_size << " B\n"
+              << "  learned index    " << std::setw(8) << learned_ns << " ns  " << std::setw(10)
+              << learned_index.MemoryUsage() - handles_size << " B\n";
+}
+
+// ./bench_index 1000000
+int main(int argc, char *argv[]) {
+    size_t n = (argc > 1) ? std::stoull(argv[1]) : 1000000;
+    size_t num_queries = 2000000;
+    std::cout << "lookup time per query, and index memory excluding the block handles" << std::endl;
+
+    std::vector<int64_t> keys(n);
+    for (size_t i = 0; i < n; ++i) keys[i] = static_cast<int64_t>(i);
+    Run("sequential", keys, num_queries);
+
+    // 时间序列：平均间隔1000，带有随机抖动
+    std::mt19937_64 rng(1);
+    int64_t t = 1600000000000LL;
+    for (size_t i = 0; i < n; ++i) {
+        t += 500 + rng() % 1000;
+        keys[i] = t;
+    }
+    Run("time series", keys, num_queries);
+
+    for (size_t i = 0; i < n; ++i) keys[i] = static_cast<int64_t>(rng());
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    Run("uniform random", keys, num_queries);
+    return 0;
+}
@@ -8,7 +8,8 @@
 
 class Test {
 public:
-    Test(const std::string &dir, bool v = true) : kvstore(dir), verbose(v) {
+    Test(const std::string &dir, bool v = true, options::CompactionStyle style = options::kCompactionStyle)
+        : kvstore(dir, options::kWalSyncMode, style), verbose(v) {
         cnt_tests = 0;
         cnt_tests_passed = 0;
         cnt_phases = 0;
@@ -4,7 +4,7 @@
 
 class TestKVStore : public Test {
 public:
-    TestKVStore(const std::string &dir, bool v) : Test(dir, v) {}
+    TestKVStore(const std::string &dir, bool v, options::CompactionStyle style) : Test(dir, v, style) {}
 
     void start_test(void *args = NULL) override {
         std::cout << "[Simple Test]" << std::endl;
@@ -38,6 +38,89 @@ private:
         }
         phase_report();
 
+        // 批量写入：奇数key整批更新，偶数key重新插入后在同一批中删除其中一半
+        WriteBatch batch;
+        for (uint64_t i = 0; i < num; ++i) {
+            batch.Put(i, std::string(i % 100 + 1, 'b'));
+            if (i % 4 == 0) batch.Del(i);
+            if (batch.Count() >= 1000) {
+                kvstore.Write(batch);
+                batch.Clear();
+            }
+        }
+        kvstore.Write(batch);
+        for (uint64_t i = 0; i < num; ++i) {
+            EXPECT((i % 4 == 0) ? "" : std::string(i % 100 + 1, 'b'), kvstore.Get(i));
+        }
+        phase_report();
+
+        // 范围查询和反向遍历：结果应该只包含i % 4 != 0的key，且按key有序
+        uint64_t live = num - num / 4 - (num % 4 != 0);
+        auto result = kvstore.Scan(0, num - 1, num);
+        uint64_t expected = 1;
+        for (const auto &pair : result) {
+            EXPECT(std::to_string(expected), std::to_string(pair.first));
+            EXPECT(std::string(expected % 100 + 1, 'b'), pair.second);
+            expected += (expected % 4 == 3) ? 2 : 1;
+        }
+        EXPECT(std::to_string(live), std::to_string(result.size()));
+
+        result = kvstore.Scan(num / 2, num - 1, 10);
+        EXPECT(std::string("10"), std::to_string(result.size()));
+
+        auto iter = kvstore.NewIterator();
+        uint64_t count = 0;
+        for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+            EXPECT(std::string(iter->Key() % 100 + 1, 'b'), iter->Value());
+            EXPECT(std::string("1"), std::to_string(iter->Key() % 4 != 0));
+            ++count;
+        }
+        EXPECT(std::to_string(live), std::to_string(count));
+
+        // 遍历方向切换后应回到原来的位置
+        iter->Seek(num / 2);
+        int64_t key = iter->Key();
+        iter->Next();
+        iter->Prev();
+        EXPECT(std::to_string(key), std::to_string(iter->Key()));
+        iter->Prev();
+        iter->Next();
+        EXPECT(std::to_string(key), std::to_string(iter->Key()));
+        phase_report();
+
+        // 快照：之后的覆盖写入(期间会flush和compaction)对快照不可见
+        const Snapshot *snapshot = kvstore.GetSnapshot();
+        for (uint64_t i = 0; i < num; ++i) {
+            kvstore.Put(i, std::string(i % 1000 + 1000, 'n'), false);
+        }
+        for (uint64_t i = 0; i < num; ++i) {
+            EXPECT(std::string(i % 1000 + 1000, 'n'), kvstore.Get(i));
+            EXPECT((i % 4 == 0) ? "" : std::string(i % 100 + 1, 'b'), kvstore.Get(i, snapshot));
+        }
+        result = kvstore.Scan(0, num - 1, num, snapshot);
+        EXPECT(std::to_string(live), std::to_string(result.size()));
+
+        // 批量查找：结果与输入的顺序一致，重复的key和不存在的key也能正确返回
+        std::vector<uint64_t> keys;
+        for (uint64_t i = 0; i < num; i += 7) keys.push_back(num - 1 - i);
+        keys.push_back(num + 100);
+        keys.push_back(keys[0]);
+        auto values = kvstore.MultiGet(keys);
+        auto snapshot_values = kvstore.MultiGet(keys, snapshot);
+        for (size_t j = 0; j < keys.size(); ++j) {
+            uint64_t i = keys[j];
+            EXPECT((i >= num) ? "" : std::string(i % 1000 + 1000, 'n'), std::string(values[j]));
+            EXPECT((i >= num || i % 4 == 0) ? "" : std::string(i % 100 + 1, 'b'), std::string(snapshot_values[j]));
+        }
+        kvstore.ReleaseSnapshot(snapshot);
+
+        // 删除是带类型的记录，与旧的删除标记内容相同的value也能正常读写
+        kvstore.Put(num, "~DELETED~", false);
+        EXPECT(std::string("~DELETED~"), kvstore.Get(num));
+        kvstore.Del(num);
+        EXPECT(std::string(""), kvstore.Get(num));
+        phase_report();
+
         final_report();
     }
 };
@@ -46,8 +129,11 @@ private:
 int main(int argc, char *argv[]) {
     bool verbose = true;
     uint64_t num = std::stoi(argv[2]);
+    // 第三个参数为universal时使用universal compaction
+    options::CompactionStyle style = (argc > 3 && std::string(argv[3]) == "universal") ?
+        options::CompactionStyle::kUniversal : options::kCompactionStyle;
 
-    TestKVStore test(argv[1], verbose);
+    TestKVStore test(argv[1], verbose, style);
 
     test.start_test((void *)&num);
 
@@ -0,0 +1,111 @@
+#include <assert.h>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "skiplist.h"
+
+// 多个线程并发写入不同的key，同时有线程无锁读取
+void TestConcurrentPut() {
+    const int thread_num = 4;
+    const int key_num = 20000;
+    SkipList table;
+    std::atomic<bool> stop(false);
+
+    // 读线程：读到的value要么为空，要么是完整的value
+    std::thread reader([&] {
+        while (!stop.load()) {
+            for (int i = 0; i < key_num; i += 97) {
+                ValueType type;
+                std::string val;
+                bool found = table.Get(i, kMaxSequenceNumber, &type, &val);
+                assert(!found || (type == kTypeValue && val == std::to_string(i)));
+            }
+        }
+    });
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < thread_num; ++t) {
+        writers.emplace_back([&, t] {
+            for (int i = t; i < key_num; i += thread_num) {
+                table.Put(i, i + 1, kTypeValue, std::to_string(i));
+            }
+        });
+    }
+    for (auto &writer : writers) writer.join();
+    stop.store(true);
+    reader.join();
+
+    assert(table.GetSize() == key_num);
+    int64_t expect = 0;
+    for (Node *node = table.GetFirstNode(); node != nullptr; node = node->Next(0)) {
+        assert(node->key_ == expect && node->GetVal() == std::to_string(expect));
+        ++expect;
+    }
+    assert(expect == key_num);
+    std::cout << "TestConcurrentPut passed" << std::endl;
+}
+
+// 多个线程并发写入相同key的不同版本，按序列号读取时看到对应的版本，Arena的内存不少于所有版本
+void TestConcurrentVersions() {
+    const int thread_num = 4;
+    const int key_num = 1000;
+    SkipList table;
+
+    // 线程t写入的版本序列号为i * thread_num + t + 1
+    std::vector<std::thread> writers;
+    for (int t = 0; t < thread_num; ++t) {
+        writers.emplace_back([&, t] {
+            for (int i = 0; i < key_num; ++i) {
+                table.Put(i, i * thread_num + t + 1, kTypeValue, std::string(t + 1, 'v'));
+            }
+        });
+    }
+    for (auto &writer : writers) writer.join();
+
+    assert(table.GetSize() == key_num * thread_num);
+    ValueType type;
+    std::string val;
+    for (int i = 0; i < key_num; ++i) {
+        assert(table.Get(i, kMaxSequenceNumber, &type, &val) && val == std::string(thread_num, 'v'));
+        for (int t = 0; t < thread_num; ++t) {
+            assert(table.Get(i, i * thread_num + t + 1, &type, &val) && val == std::string(t + 1, 'v'));
+        }
+    }
+    assert(!table.Get(0, 0, &type, &val));
+
+    // 节点和value都分配在Arena上
+    size_t memory = 0;
+    for (Node *node = table.GetFirstNode(); node != nullptr; node = node->Next(0)) {
+        memory += node->GetValLen() + sizeof(Node);
+    }
+    assert(table.ApproximateMemoryUsage() >= memory);
+
+    // 迭代器只输出每个key可见的最新版本，删除标记也是一个版本
+    auto shared = std::make_shared<SkipList>();
+    shared->Put(1, 1, kTypeValue, "a");
+    shared->Put(1, 3, kTypeValue, "b");
+    shared->Put(2, 2, kTypeValue, "c");
+    shared->Put(3, 4, kTypeValue, "d");
+    shared->Put(2, 5, kTypeDeletion, "");
+    assert(shared->Get(2, kMaxSequenceNumber, &type, &val) && type == kTypeDeletion && val.empty());
+    assert(shared->Get(2, 4, &type, &val) && type == kTypeValue && val == "c");
+    MemTableIterator iter(shared, 2);
+    iter.SeekToFirst();
+    assert(iter.Valid() && iter.Key() == 1 && iter.Value() == "a");
+    iter.Next();
+    assert(iter.Valid() && iter.Key() == 2 && iter.Value() == "c");
+    iter.Next();
+    assert(!iter.Valid());
+    iter.SeekToLast();
+    assert(iter.Valid() && iter.Key() == 2);
+    iter.Prev();
+    assert(iter.Valid() && iter.Key() == 1 && iter.Value() == "a");
+    std::cout << "TestConcurrentVersions passed" << std::endl;
+}
+
+int main() {
+    TestConcurrentPut();
+    TestConcurrentVersions();
+    return 0;
+}
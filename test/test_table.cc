@@ -0,0 +1,555 @@
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <iostream>
+#include <map>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+#include "options.h"
+#include "table_cache.h"
+#include "utils.h"
+
+// 数据块：跨重启点的delta编码、负数key，Seek和DecodeAll的结果一致
+void TestBlock() {
+    BlockBuilder builder;
+    for (int64_t i = -100; i < 100; ++i) {
+        std::string val(i + 101, 'v');
+        builder.Add(InternalKey{i * 1000, 10, kTypeValue}, val.data(), val.size());
+        builder.Add(InternalKey{i * 1000, 5, kTypeDeletion}, "", 0);
+    }
+    Block block(builder.Finish());
+
+    std::vector<std::pair<InternalKey, std::string>> entries;
+    block.DecodeAll(&entries);
+    assert(entries.size() == 400);
+    for (size_t j = 0; j < entries.size(); ++j) {
+        int64_t i = (int64_t)j / 2 - 100;
+        assert(entries[j].first.key == i * 1000);
+        assert(entries[j].first.type == ((j % 2) ? kTypeDeletion : kTypeValue));
+    }
+
+    InternalKey ikey;
+    std::string val;
+    assert(block.Seek(InternalKey{-3000, kMaxSequenceNumber}, &ikey, &val));
+    assert(ikey.key == -3000 && ikey.seq == 10 && val == std::string(98, 'v'));
+    assert(block.Seek(InternalKey{-3000, 7}, &ikey, &val));
+    assert(ikey.key == -3000 && ikey.type == kTypeDeletion && val.empty());
+    assert(block.Seek(InternalKey{-2999, kMaxSequenceNumber}, &ikey, &val) && ikey.key == -2000);
+    assert(!block.Seek(InternalKey{99001, kMaxSequenceNumber}, &ikey, &val));
+    std::cout << "TestBlock passed" << std::endl;
+}
+
+// 布隆过滤器：没有漏判，误判率与bits_per_key相符，大小与key的个数成正比
+void TestBloomFilter() {
+    for (int num : {1, 100, 10000}) {
+        std::vector<int64_t> keys;
+        for (int i = 0; i < num; ++i) keys.push_back(i * 7);
+        BloomFilter filter(BloomFilter::Build(keys, 10, false));
+        assert(filter.Size() == std::max<size_t>(8, (num * 10 + 7) / 8) + 1);
+        for (int64_t key : keys) {
+            assert(filter.KeyMayMatch(key));
+        }
+        int false_positive = 0;
+        for (int i = 0; i < 10000; ++i) {
+            if (filter.KeyMayMatch(i * 7 + 3)) ++false_positive;
+        }
+        assert(false_positive < 200);   // 10位时理论误判率约为1%
+    }
+    assert(BloomFilter().KeyMayMatch(1));
+    std::cout << "TestBloomFilter passed" << std::endl;
+}
+
+// 分块的布隆过滤器：没有漏判，批量判断与逐个判断的结果相同
+void TestBlockedBloomFilter() {
+    for (int num : {1, 100, 10000}) {
+        std::vector<int64_t> keys;
+        for (int i = 0; i < num; ++i) keys.push_back(i * 7);
+        BloomFilter filter(BloomFilter::Build(keys, 10, true));
+        assert(filter.IsBlocked());
+        assert(filter.Size() == std::max<size_t>(1, (num * 10 + 511) / 512) * 64 + 2);
+        for (int64_t key : keys) {
+            assert(filter.KeyMayMatch(key));
+        }
+
+        std::vector<int64_t> probes;
+        for (int i = 0; i < 10000; ++i) probes.push_back(i * 7 + 3);
+        std::unique_ptr<bool[]> results(new bool[probes.size()]);
+        filter.KeysMayMatch(probes.data(), probes.size(), results.get());
+        int false_positive = 0;
+        for (size_t i = 0; i < probes.size(); ++i) {
+            assert(results[i] == filter.KeyMayMatch(probes[i]));
+            if (results[i]) ++false_positive;
+        }
+        assert(false_positive < 300);
+    }
+    std::cout << "TestBlockedBloomFilter passed (avx2: " << BloomFilter::HasAvx2() << ")" << std::endl;
+}
+
+// 数据块索引：Eytzinger顺序的查找与在有序数组上lower_bound的结果一致，包括同一个key跨越多个数据块的情况
+void TestBlockIndex() {
+    for (int n : {0, 1, 2, 7, 8, 9, 100, 1000}) {
+        std::vector<BlockHandle> handles;
+        for (int i = 0; i < n; ++i) {
+            // 每3个数据块的最后一条记录是同一个key从新到旧的版本
+            handles.push_back(BlockHandle{InternalKey{(i / 3) * 10, (SequenceNumber)(100 - i % 3 * 10), kTypeValue},
+                                          (uint32_t)i, 1});
+        }
+        BlockIndex index(handles);
+        assert(index.Size() == (size_t)n);
+        for (int64_t key = -10; key <= (n / 3 + 1) * 10; ++key) {
+            auto expected = std::lower_bound(handles.begin(), handles.end(), key,
+                [](const BlockHandle &h, int64_t k) { return h.last_key.key < k; });
+            assert(index.LowerBound(key) == (size_t)(expected - handles.begin()));
+            for (SequenceNumber seq : {(SequenceNumber)0, (SequenceNumber)75, (SequenceNumber)85, kMaxSequenceNumber}) {
+                InternalKey target{key, seq};
+                auto expected_ikey = std::lower_bound(handles.begin(), handles.end(), target,
+                    [](const BlockHandle &h, const InternalKey &t) { return h.last_key < t; });
+                assert(index.LowerBound(target) == (size_t)(expected_ikey - handles.begin()));
+            }
+        }
+    }
+    std::cout << "TestBlockIndex passed" << std::endl;
+}
+
+// 学习索引：各种key分布下查找结果与lower_bound一致，key连续时只需要一段
+void TestLearnedIndex() {
+    std::vector<std::vector<int64_t>> inputs;
+    std::vector<int64_t> keys;
+    for (int64_t i = 0; i < 10000; ++i) keys.push_back(i * 16);
+    inputs.push_back(keys);
+    keys.clear();
+    for (int64_t i = 0; i < 10000; ++i) keys.push_back(i * i / 7 - 5000);     // 斜率逐渐增大
+    inputs.push_back(keys);
+    keys.clear();
+    uint64_t seed = 42;
+    for (int i = 0; i < 10000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        keys.push_back(static_cast<int64_t>(seed));                           // 覆盖整个int64_t范围
+    }
+    std::sort(keys.begin(), keys.end());
+    inputs.push_back(keys);
+    keys.clear();
+    for (int i = 0; i < 1000; ++i) keys.push_back((i / 20) * 3);             // 大量重复的key
+    inputs.push_back(keys);
+    inputs.push_back({INT64_MIN, -1, 0, 1, INT64_MAX});
+
+    for (size_t t = 0; t < inputs.size(); ++t) {
+        const std::vector<int64_t> &input = inputs[t];
+        std::string learned = LearnedIndex::Build(input, 4);
+        LearnedIndex model(learned);
+        assert(!model.Empty());
+        if (t == 0) assert(model.NumSegments() == 1);
+
+        std::vector<BlockHandle> handles;
+        for (size_t i = 0; i < input.size(); ++i) {
+            handles.push_back(BlockHandle{InternalKey{input[i], 1, kTypeValue}, (uint32_t)i, 1});
+        }
+        BlockIndex index(handles, learned);
+        assert(index.UseLearnedIndex());
+
+        std::vector<int64_t> queries = {INT64_MIN, INT64_MAX};
+        for (int64_t key : input) {
+            queries.push_back(key);
+            if (key != INT64_MIN) queries.push_back(key - 1);
+            if (key != INT64_MAX) queries.push_back(key + 1);
+        }
+        for (int64_t key : queries) {
+            size_t expected = std::lower_bound(input.begin(), input.end(), key) - input.begin();
+            assert(index.LowerBound(key) == expected);
+        }
+    }
+    assert(LearnedIndex::Build({}, 4).empty());
+    assert(LearnedIndex(std::string(7, 'x')).Empty());
+    std::cout << "TestLearnedIndex passed" << std::endl;
+}
+
+// 读写后端：多次提交的写入内容完整，超过队列深度的批量读取结果正确，读到文件末尾之后的请求失败，
+// 写请求失败只报告给对应的文件
+void TestIoBackend(const std::string &dir) {
+    utils::MkDir(dir.c_str());
+    std::string file_name = dir + "/io.dat";
+    std::string expected;
+    for (int i = 0; expected.size() < 3 * options::kWritableFileBufferSize; ++i) {
+        expected += std::to_string(i) + ",";
+    }
+
+    {
+        WritableFile file(file_name);
+        assert(file.IsOpen());
+        for (size_t pos = 0; pos < expected.size(); pos += 1000) {
+            file.Append(expected.data() + pos, std::min<size_t>(1000, expected.size() - pos));
+        }
+        assert(file.Close());
+    }
+
+    RandomAccessFile file(file_name);
+    assert(file.Size() == expected.size());
+    for (bool use_io_uring : {false, true}) {
+        std::unique_ptr<IoBackend> backend = IoBackend::Create(use_io_uring, 4);
+        const size_t num = 100, len = 777;
+        std::vector<std::string> bufs(num + 1, std::string(len, '\0'));
+        std::vector<ReadRequest> reqs;
+        for (size_t i = 0; i < num; ++i) {
+            reqs.push_back(ReadRequest{file.Fd(), (i * 7919) % (expected.size() - len), len, &bufs[i][0], false});
+        }
+        reqs.push_back(ReadRequest{file.Fd(), expected.size() - 10, len, &bufs[num][0], true});
+        backend->Read(reqs.data(), reqs.size());
+        for (size_t i = 0; i < num; ++i) {
+            assert(reqs[i].ok && bufs[i] == expected.substr(reqs[i].offset, len));
+        }
+        assert(!reqs[num].ok);
+
+        // 写请求的结果按文件描述符分别报告，取走后清除
+        std::string write_name = dir + "/write.dat";
+        int fd = ::open(write_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        backend->Write(-1, 0, "bad");
+        backend->Write(fd, 0, "good");
+        assert(backend->WaitForWrites(fd));
+        assert(!backend->WaitForWrites(-1));
+        assert(backend->WaitForWrites(-1));
+        ::close(fd);
+        assert(RandomAccessFile(write_name).Size() == 4);
+        utils::RmFile(write_name.c_str());
+        std::cout << "  backend: " << backend->Name() << std::endl;
+    }
+
+    utils::RmFile(file_name.c_str());
+    std::cout << "TestIoBackend passed" << std::endl;
+}
+
+// 限速器：低优先级请求按限速等待，高优先级请求可以透支并优先获得令牌，提高限速后等待中的请求提前返回，不限速时立即返回
+void TestRateLimiter() {
+    using Clock = std::chrono::steady_clock;
+    auto elapsed_ms = [](Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    };
+
+    // 10MB/s，补充周期10ms(100KB)，写入2MB约需要190ms
+    RateLimiter limiter(10 << 20, 10000, 10);
+    auto start = Clock::now();
+    for (int i = 0; i < 32; ++i) limiter.Request(64 << 10, IoPriority::kLow);
+    auto ms = elapsed_ms(start);
+    assert(ms >= 150 && ms < 2000);
+    assert(limiter.GetTotalBytes(IoPriority::kLow) == (uint64_t)(2 << 20));
+
+    // 高优先级请求最多透支10个周期(1MB)，不需要等待
+    RateLimiter borrow(10 << 20, 10000, 10);
+    start = Clock::now();
+    for (int i = 0; i < 16; ++i) borrow.Request(64 << 10, IoPriority::kHigh);
+    assert(elapsed_ms(start) < 50);
+
+    // 透支到上限后，先开始等待的低优先级请求要等令牌偿还完，后到的高优先级请求先获得令牌
+    std::atomic<int> finished(0);
+    int low_rank = 0;
+    std::thread low([&] {
+        borrow.Request(1, IoPriority::kLow);
+        low_rank = ++finished;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    borrow.Request(64 << 10, IoPriority::kHigh);
+    int high_rank = ++finished;
+    low.join();
+    assert(high_rank == 1 && low_rank == 2);
+    assert(elapsed_ms(start) >= 50);
+
+    // 1MB/s下透支1MB，下一个请求约需等待1s；等待期间把限速提高到100MB/s，按新的速度很快返回
+    RateLimiter slow(1 << 20, 10000, 10);
+    slow.Request(1 << 20, IoPriority::kLow);
+    start = Clock::now();
+    std::thread raise([&slow] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        slow.SetBytesPerSecond(100 << 20);
+    });
+    slow.Request(1, IoPriority::kLow);
+    raise.join();
+    ms = elapsed_ms(start);
+    assert(ms >= 40 && ms < 500);
+
+    // 不限速时立即返回
+    limiter.SetBytesPerSecond(0);
+    start = Clock::now();
+    for (int i = 0; i < 32; ++i) limiter.Request(1 << 20, IoPriority::kLow);
+    assert(elapsed_ms(start) < 50 && limiter.GetBytesPerSecond() == 0);
+    std::cout << "TestRateLimiter passed" << std::endl;
+}
+
+// 压缩算法：各种输入的压缩和解压结果一致，重复的内容可以被压缩，损坏的数据解压失败
+void TestCompression() {
+    std::vector<std::string> inputs = {"", "a", "abcd", std::string(10000, 'x')};
+    std::string text;
+    for (int i = 0; i < 1000; ++i) text += "value" + std::to_string(i % 37) + ",";
+    inputs.push_back(text);
+    std::string random;
+    uint64_t seed = 12345;
+    for (int i = 0; i < 5000; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        random.push_back(static_cast<char>(seed >> 56));
+    }
+    inputs.push_back(random);
+
+    for (CompressionType type : {kNoCompression, kFastCompression, kLZ4Compression, kZstdCompression}) {
+        if (!CompressionSupported(type)) continue;
+        for (const std::string &input : inputs) {
+            std::string compressed, output;
+            assert(Compress(type, input.data(), input.size(), &compressed));
+            assert(Uncompress(type, compressed.data(), compressed.size(), &output));
+            assert(output == input);
+            if (type != kNoCompression && input.size() >= 10000) {
+                assert(compressed.size() < input.size() / 4);
+            }
+        }
+    }
+    assert(CompressionSupported(kFastCompression));
+    assert(!CompressionSupported(static_cast<CompressionType>(100)));
+
+    // 截断或篡改的内置格式不会越界
+    std::string compressed, output;
+    Compress(kFastCompression, text.data(), text.size(), &compressed);
+    for (size_t len = 0; len < compressed.size(); ++len) {
+        assert(!Uncompress(kFastCompression, compressed.data(), len, &output));
+    }
+    for (size_t i = 0; i < compressed.size(); ++i) {
+        std::string corrupted = compressed;
+        corrupted[i] ^= 0x5a;
+        Uncompress(kFastCompression, corrupted.data(), corrupted.size(), &output);
+    }
+    std::cout << "TestCompression passed" << std::endl;
+}
+
+// SST文件：跨越多个数据块的查找、遍历和双向迭代，超过数据块大小的value单独成块
+void TestTable(const std::string &dir, CompressionType compression) {
+    utils::MkDir(dir.c_str());
+    std::string file_name = dir + "/test.sst";
+    utils::RmFile(file_name.c_str());
+
+    // 每个key有两个版本，旧版本的序列号为i + 1，新版本为key_num + i + 1，偶数key的新版本是删除标记
+    const int key_num = 5000;
+    std::map<InternalKey, std::string> expected;
+    for (int i = 0; i < key_num; ++i) {
+        expected[InternalKey{i, (SequenceNumber)(key_num + i + 1), (i % 2) ? kTypeValue : kTypeDeletion}] =
+            (i % 2) ? std::string(i % 100 + 1, 'n') : "";
+        expected[InternalKey{i, (SequenceNumber)(i + 1), kTypeValue}] =
+            std::string((i == 777) ? 10000 : i % 50 + 1, 'o');
+    }
+    TableBuilder builder(file_name, 42, compression);
+    size_t raw_size = 0;
+    for (const auto &kv : expected) {
+        builder.Add(kv.first, kv.second);
+        raw_size += kv.second.size();
+    }
+    assert(builder.Finish());
+
+    TableCache table(file_name);
+    // value都是重复的字符，压缩后文件应该明显小于value的总长度
+    if (compression != kNoCompression) assert(table.GetFileSize() < raw_size / 2);
+    assert(table.GetTimeStamp() == 42 && table.GetPairNum() == 2 * key_num);
+    assert(table.GetMinKey() == 0 && table.GetMaxKey() == key_num - 1);
+    assert(table.GetMaxSequence() == 2 * key_num);
+
+    ValueType type;
+    std::string val;
+    for (int i = 0; i < key_num; ++i) {
+        assert(table.GetValue(i, kMaxSequenceNumber, &type, &val));
+        assert((i % 2) ? (type == kTypeValue && val == std::string(i % 100 + 1, 'n')) : type == kTypeDeletion);
+        assert(table.GetValue(i, key_num + i, &type, &val) && type == kTypeValue);
+        assert(val == std::string((i == 777) ? 10000 : i % 50 + 1, 'o'));
+        assert(!table.GetValue(i, i, &type, &val));
+    }
+    assert(!table.GetValue(key_num, kMaxSequenceNumber, &type, &val));
+
+    // 顺序读取器在定位之前没有数据，定位后按内部键的顺序输出所有版本
+    TableScanner scanner(table);
+    assert(!scanner.Valid());
+    scanner.SeekToFirst();
+    for (const auto &kv : expected) {
+        assert(scanner.Valid() && scanner.Key() == kv.first && scanner.Value() == kv.second);
+        scanner.Next();
+    }
+    assert(!scanner.Valid());
+    scanner.Seek(key_num / 2);
+    assert(scanner.Valid() && scanner.Key() == expected.lower_bound(InternalKey{key_num / 2, kMaxSequenceNumber})->first);
+    scanner.Seek(key_num);
+    assert(!scanner.Valid());
+
+    // key < key_num / 2 的新版本可见，其余key只有旧版本可见
+    TableIterator iter(table, key_num + key_num / 2);
+    int count = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        int64_t i = iter.Key();
+        assert(i == count);
+        assert(iter.Type() == ((i % 2 == 0 && i < key_num / 2) ? kTypeDeletion : kTypeValue));
+        ++count;
+    }
+    assert(count == key_num);
+    for (iter.SeekToLast(); iter.Valid(); iter.Prev()) {
+        --count;
+        assert(iter.Key() == count);
+    }
+    assert(count == 0);
+
+    iter.Seek(key_num / 2);
+    assert(iter.Valid() && iter.Key() == key_num / 2);
+    iter.Prev();
+    iter.Next();
+    assert(iter.Valid() && iter.Key() == key_num / 2);
+
+    // 读取序列号为0时没有可见的版本
+    TableIterator empty_iter(table, 0);
+    empty_iter.SeekToFirst();
+    assert(!empty_iter.Valid());
+    empty_iter.SeekToLast();
+    assert(!empty_iter.Valid());
+
+    utils::RmFile(file_name.c_str());
+    std::cout << "TestTable(compression " << (int)compression << ") passed" << std::endl;
+}
+
+// 打开的文件数不超过容量；被淘汰或被删除的文件，已持有的句柄仍然可以读取
+void TestFileCache(const std::string &dir) {
+    utils::MkDir(dir.c_str());
+    std::vector<std::string> file_names;
+    for (int i = 0; i < 3; ++i) {
+        file_names.emplace_back(dir + "/cache" + std::to_string(i) + ".sst");
+        TableBuilder builder(file_names.back(), i);
+        builder.Add(InternalKey{i, 1, kTypeValue}, std::string(i + 1, 'c'));
+        builder.Finish();
+    }
+
+    FileCache file_cache(2);
+    std::vector<TableCache> tables;
+    for (const auto &file_name : file_names) {
+        tables.emplace_back(file_name, &file_cache);
+    }
+    // 第一个文件已被淘汰，再次读取时重新打开
+    ValueType type;
+    std::string val;
+    for (int i = 0; i < 3; ++i) {
+        assert(tables[i].GetValue(i, kMaxSequenceNumber, &type, &val) && val == std::string(i + 1, 'c'));
+    }
+
+    std::shared_ptr<RandomAccessFile> file = file_cache.Open(file_names[0]);
+    assert(file == file_cache.Open(file_names[0]));
+    file_cache.Evict(file_names[0]);
+    utils::RmFile(file_names[0].c_str());
+    assert(file != file_cache.Open(file_names[0]));
+    assert(!file_cache.Open(file_names[0])->IsOpen());
+    char buf[1];
+    assert(file->Read(0, 1, buf));
+
+    for (const auto &file_name : file_names) {
+        utils::RmFile(file_name.c_str());
+    }
+    std::cout << "TestFileCache passed" << std::endl;
+}
+
+// 一层文件的迭代器按key顺序跨文件遍历，只在遍历到某个文件时才打开它，构造后被删除的文件仍然可读
+void TestLevelIterator(const std::string &dir) {
+    utils::MkDir(dir.c_str());
+    const int file_num = 4, keys_per_file = 100;
+    FileCache file_cache(1);
+    std::vector<TableCache> files;
+    std::vector<int64_t> max_keys;
+    for (int i = 0; i < file_num; ++i) {
+        std::string file_name = dir + "/level" + std::to_string(i) + ".sst";
+        TableBuilder builder(file_name, i);
+        for (int j = 0; j < keys_per_file; ++j) {
+            int64_t key = (int64_t)(i * keys_per_file + j) * 2;
+            builder.Add(InternalKey{key, (SequenceNumber)key + 1, kTypeValue}, std::to_string(key));
+        }
+        builder.Finish();
+        files.emplace_back(file_name, &file_cache);
+        max_keys.push_back(files.back().GetMaxKey());
+    }
+
+    LevelIterator iter(files, max_keys, kMaxSequenceNumber);
+    // 创建后才删除的文件仍然可以遍历
+    file_cache.Evict(files[1].GetFileName());
+    utils::RmFile(files[1].GetFileName().c_str());
+
+    int64_t expected = 0;
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next(), expected += 2) {
+        assert(iter.Key() == expected && iter.Value() == std::to_string(expected));
+    }
+    assert(expected == 2 * file_num * keys_per_file);
+
+    // 落在两个文件之间的key定位到下一个文件的第一个key，再反向跨文件遍历
+    iter.Seek(2 * keys_per_file - 1);
+    assert(iter.Valid() && iter.Key() == 2 * keys_per_file);
+    iter.Prev();
+    assert(iter.Valid() && iter.Key() == 2 * keys_per_file - 2);
+    for (iter.SeekToLast(), expected = 2 * (file_num * keys_per_file - 1); iter.Valid(); iter.Prev(), expected -= 2) {
+        assert(iter.Key() == expected);
+    }
+    assert(expected == -2);
+    iter.Seek(2 * file_num * keys_per_file);
+    assert(!iter.Valid());
+
+    for (const auto &table : files) {
+        utils::RmFile(table.GetFileName().c_str());
+    }
+    std::cout << "TestLevelIterator passed" << std::endl;
+}
+
+// 数据块缓存按字节淘汰；点查询填充缓存，迭代器只使用已缓存的数据块
+void TestBlockCache(const std::string &dir) {
+    BlockCache cache(4 * (4096 + sizeof(Block)), 0);
+    for (uint64_t i = 0; i < 5; ++i) {
+        cache.Insert(1, i * 4096, std::make_shared<const Block>(std::string(4096, 'b')));
+    }
+    assert(cache.Lookup(1, 0) == nullptr);
+    assert(cache.Lookup(1, 4096) != nullptr);
+    assert(cache.GetUsage() == 4 * (4096 + sizeof(Block)));
+    cache.Insert(1, 5 * 4096, std::make_shared<const Block>(std::string(4096, 'b')));
+    assert(cache.Lookup(1, 4096) != nullptr);   // 刚访问过，淘汰的是偏移量为2 * 4096的数据块
+    assert(cache.Lookup(1, 2 * 4096) == nullptr);
+    assert(cache.Lookup(2, 4096) == nullptr);
+
+    utils::MkDir(dir.c_str());
+    std::string file_name = dir + "/cache.sst";
+    TableBuilder builder(file_name, 1);
+    for (int i = 0; i < 2000; ++i) {
+        builder.Add(InternalKey{i, 1, kTypeValue}, std::string(100, 'v'));
+    }
+    builder.Finish();
+
+    BlockCache block_cache(1 << 20, 2);
+    TableCache table(file_name, nullptr, &block_cache);
+    TableIterator iter(table, kMaxSequenceNumber);
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {}
+    assert(block_cache.GetUsage() == 0);
+
+    ValueType type;
+    std::string val;
+    assert(table.GetValue(7, kMaxSequenceNumber, &type, &val) && val == std::string(100, 'v'));
+    uint64_t misses = block_cache.GetMisses();
+    assert(table.GetValue(8, kMaxSequenceNumber, &type, &val) && val == std::string(100, 'v'));
+    assert(block_cache.GetMisses() == misses && block_cache.GetHits() == 1);
+    assert(block_cache.GetUsage() > 0);
+
+    utils::RmFile(file_name.c_str());
+    std::cout << "TestBlockCache passed" << std::endl;
+}
+
+// ./test_table ./data
+int main(int argc, char *argv[]) {
+    std::string dir = (argc > 1) ? argv[1] : "./data";
+    TestBlock();
+    TestBloomFilter();
+    TestBlockedBloomFilter();
+    TestBlockIndex();
+    TestLearnedIndex();
+    TestCompression();
+    TestIoBackend(dir + "_table");
+    TestRateLimiter();
+    for (CompressionType type : {kNoCompression, kFastCompression, kLZ4Compression, kZstdCompression}) {
+        if (CompressionSupported(type)) TestTable(dir + "_table", type);
+    }
+    TestFileCache(dir + "_table");
+    TestLevelIterator(dir + "_table");
+    TestBlockCache(dir + "_table");
+    return 0;
+}
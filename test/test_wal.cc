@@ -0,0 +1,128 @@
+#include <assert.h>
+#include <iostream>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <thread>
+#include <vector>
+
+#include "kvstore.h"
+
+// 逻辑记录编码、物理记录写入后能被完整读出，写到一半的记录会被丢弃
+void TestWalRecord(const std::string &dir) {
+    std::string file_name = dir + "/test.log";
+    utils::MkDir(dir.c_str());
+    utils::RmFile(file_name.c_str());
+
+    {
+        WalWriter writer(file_name, options::WalSyncMode::kSyncEveryWrite);
+        for (int i = 0; i < 100; ++i) {
+            std::string payload;
+            wal::EncodeRecord(&payload, wal::kTypeValue, i, std::string(i + 1, 'v'));
+            wal::EncodeRecord(&payload, wal::kTypeDeletion, -i, "");
+            bool ok = writer.AddRecord(payload);
+            assert(ok);
+        }
+    }
+    // 模拟最后一条记录只写了一半
+    struct stat st;
+    stat(file_name.c_str(), &st);
+    truncate(file_name.c_str(), st.st_size - 3);
+
+    WalReader reader(file_name);
+    std::string payload, val;
+    int num = 0;
+    while (reader.ReadRecord(&payload)) {
+        size_t pos = 0;
+        wal::RecordType type;
+        int64_t key;
+        bool ok = wal::DecodeRecord(payload, &pos, &type, &key, &val);
+        assert(ok && type == wal::kTypeValue && key == num && val == std::string(num + 1, 'v'));
+        ok = wal::DecodeRecord(payload, &pos, &type, &key, &val);
+        assert(ok && type == wal::kTypeDeletion && key == -num && val.empty());
+        ok = wal::DecodeRecord(payload, &pos, &type, &key, &val);
+        assert(!ok);
+        (void)ok;
+        ++num;
+    }
+    assert(num == 99);
+    utils::RmFile(file_name.c_str());
+    std::cout << "TestWalRecord passed" << std::endl;
+}
+
+// 没有正常关闭(不调用析构函数)时，重新打开后能从WAL恢复所有写入
+void TestRecover(const std::string &dir) {
+    const int num = 1000;
+    // 在子进程中写入后直接_exit，不调用析构函数，模拟进程崩溃。父进程等子进程退出后再打开同一个目录
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        KVStore store(dir);
+        store.Reset();
+        for (int i = 0; i < num; ++i) {
+            store.Put(i, std::string(i % 50 + 1, 'a'));
+        }
+        for (int i = 0; i < num; i += 3) {
+            store.Del(i);
+        }
+        // 多个线程并发写入，由组提交合并
+        std::vector<std::thread> writers;
+        for (int t = 0; t < 4; ++t) {
+            writers.emplace_back([&store, t] {
+                for (int i = num + t; i < 2 * num; i += 4) {
+                    store.Put(i, std::to_string(i));
+                }
+            });
+        }
+        for (auto &writer : writers) writer.join();
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    KVStore recovered(dir);
+    for (int i = 0; i < num; ++i) {
+        assert(recovered.Get(i) == ((i % 3 == 0) ? "" : std::string(i % 50 + 1, 'a')));
+    }
+    for (int i = num; i < 2 * num; ++i) {
+        assert(recovered.Get(i) == std::to_string(i));
+    }
+    recovered.Reset();
+    std::cout << "TestRecover passed" << std::endl;
+}
+
+// 析构前线程池中还没有执行的写任务也会写入，重新打开后都能读到
+void TestCloseWithPendingTasks(const std::string &dir) {
+    const int num = 2000;
+    {
+        KVStore store(dir);
+        store.Reset();
+        for (int i = num; i < 2 * num; ++i) {
+            store.Put(i, std::to_string(i));
+        }
+        // 线程池中的任务没有先后顺序，删除的是之前同步写入的key
+        for (int i = 0; i < num; ++i) {
+            store.PutTask(i, std::to_string(i));
+            store.DelTask(num + i);
+        }
+    }
+    KVStore reopened(dir);
+    for (int i = 0; i < 2 * num; ++i) {
+        assert(reopened.Get(i) == ((i >= num) ? "" : std::to_string(i)));
+    }
+    reopened.Reset();
+    // Reset同时清空cache_，缓存的值不会再被读到
+    reopened.Put(0, "cached");
+    reopened.Reset();
+    assert(reopened.Get(0) == "");
+    std::cout << "TestCloseWithPendingTasks passed" << std::endl;
+}
+
+// ./test_wal ./data
+int main(int argc, char *argv[]) {
+    std::string dir = (argc > 1) ? argv[1] : "./data";
+    TestWalRecord(dir + "_wal");
+    TestRecover(dir);
+    TestCloseWithPendingTasks(dir);
+    return 0;
+}